@@ -0,0 +1,35 @@
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "current_sense.h"
+#include "supply.h"
+
+/*
+ * Shared ADC driver.
+ *
+ * The current shunt and the supply monitor share the one converter. Each
+ * enables its channel with adc_start() for as long as it needs samples,
+ * and ADC_vect runs one single conversion per enabled channel in turn,
+ * handing every result to the module that owns the channel. The ADC runs
+ * at clk/128 against the internal 2.56V reference, about 4.8k conversions
+ * per second split between the enabled channels, and is switched off once
+ * no channel is enabled.
+ */
+
+#define ADC_ENABLE (CURRENT_SENSE_ENABLE || SUPPLY_MONITOR_ENABLE)
+
+#if CURRENT_SENSE_ENABLE && SUPPLY_MONITOR_ENABLE && CURRENT_SENSE_CHANNEL == SUPPLY_CHANNEL
+#error "The current shunt and the supply divider need different ADC channels"
+#endif
+
+#if ADC_ENABLE
+
+void adc_start(uint8_t channel);
+void adc_stop(uint8_t channel);
+
+#endif
+
+#endif
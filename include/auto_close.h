@@ -0,0 +1,61 @@
+#ifndef AUTO_CLOSE_H
+#define AUTO_CLOSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional auto-close, counted by the Timer2 watch crystal (see rtc.h).
+ *
+ * Timer2 overflows exactly once a second, in every sleep mode down to
+ * power-save. While the countdown is armed, TIMER2_OVF_vect takes one
+ * second off it per overflow and latches auto_close_due() when it runs
+ * out; the foreground does no work at all until then, and nothing runs
+ * while it is disarmed.
+ *
+ * The gate state machine arms the countdown when a run arrives fully
+ * open and disarms it on any event it acts on, so a new command or a
+ * toggle cancels it. A stop while the gate waits open cancels it too, and
+ * an open to a gate that is already open restarts it. An obstructed
+ * auto-close reverses to open and arrives there again, which re-arms the
+ * countdown, but only AUTO_CLOSE_ATTEMPTS times in a row; after that the
+ * gate stays open until told otherwise.
+ *
+ * The crystal needs about a second to start after power-up, so the first
+ * countdown after a reset may run a little long.
+ */
+
+#ifndef AUTO_CLOSE_ENABLE
+#define AUTO_CLOSE_ENABLE 0
+#endif
+
+#ifndef AUTO_CLOSE_S
+#define AUTO_CLOSE_S 60              // Close this long after arriving open
+#endif
+#ifndef AUTO_CLOSE_ATTEMPTS
+#define AUTO_CLOSE_ATTEMPTS 3        // Consecutive auto-closes before giving up
+#endif
+
+#if AUTO_CLOSE_S < 1 || AUTO_CLOSE_S > 65535
+#error "AUTO_CLOSE_S must be between 1 and 65535 seconds"
+#endif
+
+#if AUTO_CLOSE_ENABLE
+
+void auto_close_arm(void);
+void auto_close_cancel(void);
+bool auto_close_armed(void);
+bool auto_close_due(void);
+
+#else
+
+static inline void auto_close_arm(void) {}
+static inline void auto_close_cancel(void) {}
+static inline bool auto_close_armed(void) { return false; }
+static inline bool auto_close_due(void) { return false; }
+
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Momentary button / remote receiver input on INT0.
+ *
+ * INT0 fires on every edge and timestamps it; the system tick classifies
+ * the pattern as it unfolds. A burst starts at the first falling edge and
+ * ends once the line has stayed high for BUTTON_GAP_MS, so contact bounce
+ * and receiver chatter inside one press are ignored:
+ *
+ *   BUTTON_EVT_NOISE   the burst ended before BUTTON_DEBOUNCE_DELAY, e.g. a
+ *                      spike from the receiver or a cold-night false trigger
+ *   BUTTON_EVT_PRESS   the line is still low BUTTON_DEBOUNCE_DELAY after the
+ *                      burst started; reported right then, not on release
+ *   BUTTON_EVT_DOUBLE  as PRESS, but the burst started within
+ *                      BUTTON_DOUBLE_MS of the previous press being released;
+ *                      the main loop acts on it as a PRESS, so a double tap
+ *                      on a moving gate stops it and then reverses it
+ *   BUTTON_EVT_LONG    a confirmed press is still held at BUTTON_LONG_MS,
+ *                      reported once in addition to its PRESS or DOUBLE
+ *
+ * ICP1 already belongs to the hall sensor, so edges are stamped with
+ * millis(); every threshold is several ticks long. Events wait in an
+ * event_queue_t until button_poll() collects them, so a burst of presses
+ * during a long foreground pass is neither merged nor lost.
+ *
+ * The longest foreground pass, the CMD_EVENT_LOG dump at rest, blocks for
+ * about 200ms. Each press needs BUTTON_DEBOUNCE_DELAY, so such a pass sees
+ * at most two PRESS or DOUBLE events and the LONG of an earlier press:
+ * BUTTON_BURST_EVENTS. A NOISE burst can be as short as BUTTON_GAP_MS, so
+ * those could fill any queue; they only get a slot while BUTTON_BURST_EVENTS
+ * stay free, and the rest are dropped and counted. The 8-slot queue holds
+ * 7, so four noise events fit alongside the worst burst.
+ */
+
+#define BUTTON_PIN PD2
+#ifndef BUTTON_DEBOUNCE_DELAY
+#define BUTTON_DEBOUNCE_DELAY 100    // Held this long (from the first edge) is a press
+#endif
+#ifndef BUTTON_GAP_MS
+#define BUTTON_GAP_MS 10             // High for less than this is bounce, not a release
+#endif
+#ifndef BUTTON_LONG_MS
+#define BUTTON_LONG_MS 2000          // Held this long is also a long press
+#endif
+#ifndef BUTTON_DOUBLE_MS
+#define BUTTON_DOUBLE_MS 600         // Release to next press for a double press
+#endif
+
+#define BUTTON_BURST_EVENTS 3        // Most presses one long foreground pass can confirm
+
+#if BUTTON_DEBOUNCE_DELAY <= BUTTON_GAP_MS || BUTTON_LONG_MS <= BUTTON_DEBOUNCE_DELAY
+#error "Button timing must run BUTTON_GAP_MS < BUTTON_DEBOUNCE_DELAY < BUTTON_LONG_MS"
+#endif
+
+#define BUTTON_EVT_NONE 0
+#define BUTTON_EVT_PRESS 1
+#define BUTTON_EVT_DOUBLE 2
+#define BUTTON_EVT_LONG 3
+#define BUTTON_EVT_NOISE 4
+
+void button_init(void);
+void button_tick(void);
+uint8_t button_poll(void);
+bool button_idle(void);
+uint8_t button_dropped(void);
+uint8_t button_max_wait_ms(void);
+void button_clear_stats(void);
+
+#endif
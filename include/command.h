@@ -0,0 +1,69 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Framed command channel on the UART.
+ *
+ * Requests and replies share one frame format:
+ *
+ *   STX (0x02) | ADDR | CMD | LEN | PAYLOAD[LEN] | CRC
+ *
+ * CRC is CRC-8 (polynomial 0x07, initial value 0) over ADDR, CMD, LEN and
+ * the payload. A controller answers frames sent to COMMAND_NODE_ADDR with
+ * CMD | 0x80 and the same ADDR. Frames sent to COMMAND_BROADCAST_ADDR are
+ * executed but never answered, so several gates can share one RS-485 bus.
+ * A gap longer than COMMAND_BYTE_TIMEOUT_MS inside a frame drops it and the
+ * parser resynchronises on the next STX.
+ *
+ * Commands are explicit and idempotent: OPEN on a gate that is fully open
+ * or opening, CLOSE on one that is fully closed or closing, and STOP on one
+ * that is standing still all succeed without doing anything.
+ */
+
+#ifndef COMMAND_NODE_ADDR
+#define COMMAND_NODE_ADDR 0x01
+#endif
+
+#define COMMAND_BROADCAST_ADDR 0xFF
+#define COMMAND_STX 0x02
+#define COMMAND_REPLY 0x80
+#define COMMAND_MAX_PAYLOAD 8
+#define COMMAND_BYTE_TIMEOUT_MS 20
+
+#define CMD_OPEN 'O'
+#define CMD_CLOSE 'C'
+#define CMD_STOP 'S'
+#define CMD_STATUS '?'
+#define CMD_BOOT 'B'                 // Boot-to-ready time and reset cause of this boot
+#define CMD_EVENTS 'E'               // Binary telemetry builds only, see telemetry.h
+#define CMD_EVENT_LOG 'L'            // Dump the EEPROM event log, see event_log.h
+#define CMD_INSTRUMENT 'I'           // Instrumented builds only, see instrument.h
+#define CMD_STATS 'M'                // Relay and motor maintenance counters, see stats.h
+
+#define CMD_RESULT_OK 0              // Command started or performed
+#define CMD_RESULT_NO_CHANGE 1       // Already in the requested state
+#define CMD_RESULT_UNKNOWN 2         // Unknown command
+#define CMD_RESULT_BUSY 3            // Refused while the gate moves, ask again once it stops
+
+typedef struct {
+    uint8_t addr;
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[COMMAND_MAX_PAYLOAD];
+} command_t;
+
+bool command_poll(command_t* cmd);
+bool command_idle(void);
+void command_reply(const command_t* cmd, const uint8_t* payload, uint8_t len);
+
+// Streaming form of command_reply() for payloads too large to buffer
+bool command_reply_begin(const command_t* cmd, uint8_t len);
+void command_reply_byte(uint8_t b);
+void command_reply_end(void);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/*
+ * Build-time site profile.
+ *
+ * `make PROFILE=name` compiles every file with GATE_PROFILE_HEADER set to
+ * "profiles/name.h". Each header with a tunable includes this one before
+ * its defaults, and every default is wrapped in #ifndef, so a value set in
+ * the profile wins everywhere it is used, including the sim and the #error
+ * checks next to each default that reject values the hardware or the code
+ * cannot handle. Everything stays a compile-time constant.
+ *
+ * The clock is set here rather than on the compiler command line because
+ * the timer and UART dividers are derived from it.
+ */
+
+#ifdef GATE_PROFILE_HEADER
+#include GATE_PROFILE_HEADER
+#endif
+
+#ifndef F_CPU
+#define F_CPU 8000000UL              // 8MHz external crystal
+#endif
+
+#endif
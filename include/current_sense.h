@@ -0,0 +1,52 @@
+#ifndef CURRENT_SENSE_H
+#define CURRENT_SENSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional motor current sensing for end-of-travel detection.
+ *
+ * A low-side shunt in the H-bridge ground return feeds ADC0 (PA0). The
+ * shared ADC driver converts it while the motor is powered and every
+ * sample is folded into a fixed-point moving average: 16 samples are
+ * averaged into a block and the last 8 blocks are averaged again (about
+ * 27ms of history, twice that while the supply monitor shares the ADC).
+ *
+ * Each stroke ignores the start-up inrush, then learns the running current
+ * of this stroke and arms a stall threshold at CURRENT_STALL_RATIO times
+ * that level. Current held above the threshold for CURRENT_STALL_CONFIRM_MS
+ * means the motor is pushing against its internal endstop.
+ */
+
+#ifndef CURRENT_SENSE_ENABLE
+#define CURRENT_SENSE_ENABLE 0
+#endif
+
+#define CURRENT_SENSE_CHANNEL 0      // ADC0 / PA0
+#define CURRENT_INRUSH_MS 1000       // Ignore the start-up surge
+#define CURRENT_LEARN_MS 2000        // Then average the running current
+#define CURRENT_STALL_RATIO_Q4 24    // Stall at 1.5x the learned current (Q4 fixed point)
+#define CURRENT_STALL_MIN 40         // Never arm below this many ADC counts
+#define CURRENT_STALL_CONFIRM_MS 200 // Must stay above threshold this long
+
+#if CURRENT_SENSE_ENABLE
+
+void current_sense_start(void);
+void current_sense_stop(void);
+bool current_sense_stalled(void);
+uint16_t current_sense_level(void);
+void current_sense_sample(uint16_t value);
+
+#else
+
+static inline void current_sense_start(void) {}
+static inline void current_sense_stop(void) {}
+static inline bool current_sense_stalled(void) { return false; }
+static inline uint16_t current_sense_level(void) { return 0; }
+
+#endif
+
+#endif
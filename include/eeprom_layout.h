@@ -0,0 +1,36 @@
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+/*
+ * EEPROM map for the ATmega8535 (512 bytes).
+ *
+ * Firmware before the journal stored the gate state at 0x00 and the
+ * controlled reset flag at 0x01. Those bytes now belong to the journal and
+ * are only read once, to migrate an old unit on its first boot.
+ */
+
+#define EE_SIZE 512
+
+#define EE_LEGACY_STATE 0x00
+#define EE_LEGACY_RESET_FLAG 0x01
+
+#define EE_JOURNAL_START 0x000
+#define EE_JOURNAL_END 0x100
+
+#define EE_EVENT_LOG_START 0x100     // Timestamped event ring, see event_log.h
+#define EE_EVENT_LOG_END 0x1B0
+
+#define EE_STATS_START 0x1B0         // Two copies of the maintenance counters, see stats.h
+#define EE_STATS_END 0x1E0
+
+#define EE_TRAVEL_START 0x1E0        // Learned open/close durations
+#define EE_TRAVEL_END 0x1F0
+
+#define EE_POWER_FAIL_START 0x1F0    // Position saved on a supply sag, see supply.h
+#define EE_POWER_FAIL_END 0x1F1
+
+#if EE_POWER_FAIL_END > EE_SIZE
+#error "EEPROM layout exceeds the device"
+#endif
+
+#endif
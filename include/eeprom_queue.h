@@ -0,0 +1,47 @@
+#ifndef EEPROM_QUEUE_H
+#define EEPROM_QUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Queued EEPROM writer.
+ *
+ * A byte write takes about 8.5ms of programming time. Instead of waiting
+ * for it, callers queue (address, value) pairs and EE_RDY_vect programs
+ * them one after another in the background. Bytes that already hold the
+ * queued value are skipped, like eeprom_update_byte().
+ *
+ * Writes are applied in the order they were queued. Every EEPROM read
+ * goes through ee_queue_read() or ee_queue_read_block(), never avr-libc's
+ * eeprom_read_*(): those poll EEWE and then take EEAR, and EE_RDY_vect
+ * fires in between the moment a write completes, starts the next one and
+ * makes the read return whatever it programmed. The queue's reads mask
+ * EERIE around the access and return the bytes with the writes still
+ * queued for them applied, so no reader needs ee_queue_flush(). When the
+ * queue is full the caller waits for a free entry, which needs interrupts
+ * enabled.
+ *
+ * ee_queue_urgent() holds one more byte, which EE_RDY_vect programs before
+ * anything still queued, at most one programming time after the write in
+ * progress. It never waits, so interrupt handlers can use it, and a byte
+ * it hasn't started yet is replaced by the next one. It is meant for a
+ * single address that is only ever written that way, the supply
+ * monitor's power-fail record; queued bytes for the same address would
+ * land after it.
+ */
+
+#define EE_QUEUE_SIZE 32             // Must be a power of two
+#define EE_QUEUE_MASK (EE_QUEUE_SIZE - 1)
+
+#if (EE_QUEUE_SIZE & EE_QUEUE_MASK) || EE_QUEUE_SIZE > 256
+#error "EE_QUEUE_SIZE must be a power of two no larger than 256"
+#endif
+
+void ee_queue_write(uint16_t addr, uint8_t value);
+void ee_queue_urgent(uint16_t addr, uint8_t value);
+uint8_t ee_queue_read(uint16_t addr);
+void ee_queue_read_block(void* dst, uint16_t addr, uint16_t len);
+uint8_t ee_queue_idle(void);
+void ee_queue_flush(void);
+
+#endif
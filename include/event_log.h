@@ -0,0 +1,42 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdint.h>
+
+#include "command.h"
+#include "eeprom_layout.h"
+
+/*
+ * Persistent event log.
+ *
+ * A ring of fixed 8-byte records in EEPROM, written through the EEPROM
+ * queue so logging never blocks:
+ *
+ *   byte 0   sequence number (wraps, newest = highest in the window)
+ *   byte 1   event id (EVT_* from telemetry.h)
+ *   byte 2   argument: MCUCSR for EVT_BOOT, the HEALTH_* code for
+ *            EVT_HEALTH_FAULT, the gate state otherwise
+ *   byte 3-6 uptime in seconds since that boot, little-endian
+ *   byte 7   CRC-8 over bytes 0-6, seeded like the journal
+ *
+ * EVT_BOOT records mark each restart and carry its reset cause, so the
+ * uptime of the records that follow it is relative to that boot.
+ *
+ * event_log_dump() streams every slot, oldest first, as a single
+ * CMD_EVENT_LOG reply frame; the host drops slots that fail their CRC.
+ * The frame waits on the UART for about 190ms at 9600 baud, so the main
+ * loop refuses the command with CMD_RESULT_BUSY while the motor runs.
+ */
+
+#define EVENT_LOG_RECORD_SIZE 8
+#define EVENT_LOG_SLOTS ((EE_EVENT_LOG_END - EE_EVENT_LOG_START) / EVENT_LOG_RECORD_SIZE)
+
+#if EVENT_LOG_SLOTS > 128
+#error "Sequence numbers need a window of at most 128 slots"
+#endif
+
+void event_log_init(void);
+void event_log_record(uint8_t evt, uint8_t arg);
+void event_log_dump(const command_t* cmd);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Single-producer, single-consumer queue of timestamped events.
+ *
+ * Each interrupt source that hands events to the main loop owns one queue:
+ * the ISR is the only writer of head and the foreground the only writer of
+ * tail, so neither side ever disables interrupts. Both indices are single
+ * bytes, which the AVR reads and writes in one instruction. The producer
+ * fills the slot before publishing it by moving head, and the consumer
+ * reads the slot before releasing it by moving tail; the slots are
+ * volatile so the compiler keeps that order.
+ *
+ * A full queue drops the new event and counts it in dropped rather than
+ * overwrite one not yet seen. A producer can keep slots free for events
+ * that matter more, so a flood of minor ones never crowds them out. The
+ * consumer keeps max_wait_ms, the longest any event sat in the queue,
+ * which bounds the interrupt-to-foreground latency actually seen.
+ * Instrumented builds report both for the button queue in the
+ * CMD_INSTRUMENT reply.
+ *
+ * The button is the one source whose events the foreground must see one
+ * by one, in order. The other ISRs keep what they already had:
+ *
+ *   UART RX          a byte stream; its ring is this same single-writer
+ *                    design at one byte per slot instead of three
+ *   hall, supply     the ISR acts itself by cutting the relays, and only
+ *                    latches one flag a run for the aftermath
+ *   auto-close       Timer2 fires once per countdown, one flag is enough
+ */
+
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 8           // Must be a power of two, holds one less
+#endif
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE - 1)
+
+#if (EVENT_QUEUE_SIZE & EVENT_QUEUE_MASK) || EVENT_QUEUE_SIZE > 256
+#error "EVENT_QUEUE_SIZE must be a power of two no larger than 256"
+#endif
+
+typedef struct {
+    uint8_t type;
+    uint16_t ms;                     // Low 16 bits of millis() when queued
+} event_t;
+
+typedef struct {
+    volatile event_t slots[EVENT_QUEUE_SIZE];
+    volatile uint8_t head;           // Written by the producer only
+    volatile uint8_t tail;           // Written by the consumer only
+    volatile uint8_t dropped;        // Written by the producer only
+    uint8_t max_wait_ms;             // Written by the consumer only
+} event_queue_t;
+
+// Producer side, normally called from an ISR; fails unless `keep_free`
+// slots are left over after this one
+static inline bool event_push(event_queue_t* q, uint8_t type, uint16_t now_ms, uint8_t keep_free) {
+    uint8_t head = q->head;
+    uint8_t next = (head + 1) & EVENT_QUEUE_MASK;
+    uint8_t space = (q->tail - head - 1) & EVENT_QUEUE_MASK;
+    if (space <= keep_free) {
+        if (q->dropped < UINT8_MAX) q->dropped++;
+        return false;
+    }
+    q->slots[head].type = type;
+    q->slots[head].ms = now_ms;
+    q->head = next;
+    return true;
+}
+
+// Consumer side, called from the main loop
+static inline bool event_pending(const event_queue_t* q) {
+    return q->tail != q->head;
+}
+
+// Consumer side; dropped is the producer's, but a one-byte store can't split its increment
+static inline void event_stats_clear(event_queue_t* q) {
+    q->dropped = 0;
+    q->max_wait_ms = 0;
+}
+
+static inline bool event_pop(event_queue_t* q, event_t* out, uint16_t now_ms) {
+    uint8_t tail = q->tail;
+    if (tail == q->head) return false;
+    out->type = q->slots[tail].type;
+    out->ms = q->slots[tail].ms;
+    q->tail = (tail + 1) & EVENT_QUEUE_MASK;
+
+    uint16_t wait = now_ms - out->ms;
+    if (wait > q->max_wait_ms) q->max_wait_ms = wait > UINT8_MAX ? UINT8_MAX : wait;
+    return true;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef GATE_H
+#define GATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "travel.h"
+
+/*
+ * Table-driven gate state machine.
+ *
+ * Every (event, state) pair has one entry in a PROGMEM table giving the
+ * next state, a log note and a set of action flags. gate_dispatch() reads
+ * the entry and runs the flagged actions in a fixed order:
+ *
+ *   GATE_DO_STOP          stop the motor, log an emergency stop
+ *   GATE_DO_ARRIVAL       log whether the run ended on the endstop
+ *   GATE_DO_OBSTRUCTION   log the obstruction
+ *   GATE_DO_POWER_FAIL    log the supply sag
+ *   (the note)            say why the state is changing
+ *   GATE_DO_RUN           start the motor towards the next state
+ *   (the state change)
+ *   GATE_DO_STORE         write the next state and position to the journal,
+ *                         which GATE_DO_RUN does as well
+ *   (report the state)
+ *   GATE_DO_AUTO_CLOSE    arm the auto-close countdown, see auto_close.h
+ *
+ * An entry without flags ignores the event. GATE_IF_PARTIAL ignores it too
+ * when the gate already sits at the end the current state names, so a
+ * command to open a gate that stopped part way still runs. A new state or
+ * event adds a table row or column, not code.
+ *
+ * A run journals the moving state and its starting position as it starts,
+ * and while the motor runs gate_checkpoint() journals the estimated
+ * position each time the gate has moved GATE_CHECKPOINT_STEP since the
+ * last record, except at the end of travel, where the stop record
+ * follows. After a power cut the gate comes back at the last checkpoint
+ * instead of at an end of travel, and the next command only drives for
+ * what is left. The gate may have gone up to a step further
+ * in the direction it was moving, gate_stored_slack(). A run back the
+ * other way drives for that step as well, so it still reaches the end,
+ * and a run on the same way takes a stop up to a step early as the end.
+ *
+ * A full stroke adds five records to the journal: the start, three
+ * checkpoints and the stop. At 100,000 writes per cell and one write per
+ * JOURNAL_SLOTS (64) records, the journal lasts about 1.3 million strokes,
+ * 640,000 open and close cycles.
+ */
+
+#define GATE_CLOSED 0
+#define GATE_CLOSING 1
+#define GATE_OPENING 2
+#define GATE_OPEN 3
+#define GATE_STATES 4
+
+#define GATE_EV_TOGGLE 0             // Button while the motor is idle
+#define GATE_EV_STOP 1               // Button while moving, stop command
+#define GATE_EV_OPEN 2               // Open command
+#define GATE_EV_CLOSE 3              // Close command
+#define GATE_EV_ARRIVED 4            // motion_poll() finished a run
+#define GATE_EV_OBSTRUCTED 5         // motion_poll() stopped for an obstruction
+#define GATE_EV_POWER_FAIL 6         // motion_poll() stopped for a supply sag
+#define GATE_EV_AUTO_CLOSE 7         // The auto-close countdown ran out
+#define GATE_EVENTS 8
+
+#ifndef GATE_CHECKPOINT_STEP
+#define GATE_CHECKPOINT_STEP (TRAVEL_POS_OPEN / 4)   // Journal the position every quarter stroke
+#endif
+
+extern uint8_t gate_state;
+
+void gate_init(void);
+uint8_t gate_stored_state(void);
+uint16_t gate_stored_position(void);
+int16_t gate_stored_slack(void);
+void gate_store(void);
+void gate_checkpoint(void);
+bool gate_accepts(uint8_t event);
+bool gate_dispatch(uint8_t event);
+void gate_report(void);
+
+#endif
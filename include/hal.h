@@ -0,0 +1,34 @@
+#ifndef HAL_H
+#define HAL_H
+
+/*
+ * Seam between the firmware and the host simulator.
+ *
+ * The firmware drives the hardware through avr-libc's register names. The
+ * simulator in sim/ builds the same sources against its own <avr/...>
+ * headers, in which those registers are variables, so register code needs
+ * no wrapper. What a header cannot stand in for is time passing inside a
+ * busy wait, so every wait loop spins on hal_spin(): nothing on the
+ * target, one step of simulated time on the host. Nor is there a real
+ * stack on the host, so hal_stack_floor() and hal_stack_top() bound the
+ * free RAM between .bss and the stack pointer on the target and a spare
+ * array in the simulator.
+ */
+
+#include <stdint.h>
+
+#ifdef SIM_BUILD
+#define SIM_STACK_SIZE 128
+extern uint8_t sim_stack[SIM_STACK_SIZE];
+void sim_spin(void);
+#define hal_spin() sim_spin()
+#define hal_stack_floor() (sim_stack)
+#define hal_stack_top() (sim_stack + SIM_STACK_SIZE)
+#else
+extern uint8_t __bss_end;                    // From the avr-libc linker script
+#define hal_spin() ((void)0)
+#define hal_stack_floor() (&__bss_end)
+#define hal_stack_top() ((uint8_t*)SP)
+#endif
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HALL_H
+#define HALL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional hall-sensor obstruction detection on ICP1 (PD6).
+ *
+ * A hall sensor on the motor or pinion shaft pulses once per revolution.
+ * Timer1 free-runs at 1MHz and captures every rising edge, so the pulse
+ * period is the inverse of motor speed. After HALL_SPINUP_MS the average
+ * period of this stroke is learned and a limit is armed at HALL_SLOW_RATIO
+ * times that period. Output compare B is kept one limit ahead of the last
+ * edge; if the next edge is late, TIMER1_COMPB_vect cuts the relays from
+ * interrupt context and the foreground only handles the aftermath.
+ *
+ * Worst-case reaction time from the instant speed falls below the profile
+ * to the relay outputs going low is the armed limit (the edge that proves
+ * the motor is slow cannot arrive sooner) plus interrupt latency. AVR
+ * interrupts don't nest, and TIMER1_COMPB_vect ranks below INT0, INT1,
+ * both Timer2 vectors, TIMER1_CAPT and TIMER1_COMPA, so the trip can wait
+ * for whichever handler is running, then for each of those once. Costs
+ * estimated from the source, prologue and epilogue included:
+ *
+ *   Lower priority, at most one of them already running:
+ *   EE_RDY_vect skipping a full queue of unchanged bytes   about 320 cycles
+ *   TIMER0_COMP_vect: tick, button_tick(), motion_tick()   about 200
+ *   ADC_vect: a current or supply sample                   about 150
+ *   USART_UDRE_vect 80, USART_RXC_vect 75
+ *   TIMER1_OVF_vect 45 (instrumented builds)
+ *
+ *   Higher priority, each at most once:
+ *   INT0_vect 120, INT1_vect 80, both Timer2 vectors 60
+ *   TIMER1_CAPT_vect 90, TIMER1_COMPA_vect 90 (soft PWM)
+ *
+ * Foreground ATOMIC_BLOCKs are all shorter, the longest being the limit
+ * arming in hall_poll() at about 100 cycles. ADC_vect's brown-out path runs
+ * longer but cuts the relays itself first, and no handler waits on EEPROM
+ * any more. The worst case is EE_RDY_vect, the longest handler below,
+ * plus one of each higher priority, about 760 cycles, so latency is
+ * bounded by roughly 100us at 8MHz. The cap on the limit, HALL_MAX_PERIOD_US, therefore bounds the
+ * total to about 50.1ms. A handler added above TIMER1_COMPB or longer than
+ * EE_RDY_vect changes this figure.
+ *
+ * The gate also stops turning at its endstops. A trip within
+ * TRAVEL_END_WINDOW of the estimated end of travel ends the run as an
+ * endstop instead, see travel_at_end().
+ */
+
+#ifndef HALL_SENSOR_ENABLE
+#define HALL_SENSOR_ENABLE 0
+#endif
+
+#ifndef HALL_REVERSE_ON_OBSTRUCTION
+#define HALL_REVERSE_ON_OBSTRUCTION HALL_SENSOR_ENABLE // Re-open when obstructed while closing
+#endif
+
+#define HALL_PIN PD6
+#define HALL_SPINUP_MS 1500          // Motor reaches speed before the limit is armed
+#define HALL_LEARN_MS 1000           // Average period over this long after spin-up
+#define HALL_SLOW_RATIO_Q4 24        // Obstructed below 1/1.5 of learned speed (Q4 fixed point)
+#define HALL_MAX_PERIOD_US 50000U    // Never allow a period longer than this
+
+#if HALL_MAX_PERIOD_US > 60000U
+#error "HALL_MAX_PERIOD_US must fit comfortably in the 16-bit Timer1 range"
+#endif
+
+#if HALL_SENSOR_ENABLE
+
+void hall_init(void);
+void hall_start(void);
+void hall_stop(void);
+void hall_poll(void);
+bool hall_obstructed(void);
+uint16_t hall_period_us(void);
+
+#else
+
+static inline void hall_init(void) {}
+static inline void hall_start(void) {}
+static inline void hall_stop(void) {}
+static inline void hall_poll(void) {}
+static inline bool hall_obstructed(void) { return false; }
+static inline uint16_t hall_period_us(void) { return 0; }
+
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+
+/*
+ * Runtime health supervisor.
+ *
+ * The controller used to reboot every few hours of idle time as a
+ * precaution. It now stays up until health_poll(), called on every main
+ * loop pass, finds something actually wrong:
+ *
+ *   HEALTH_TICK       the 1ms tick ISR stopped counting while the loop
+ *                     kept waking up for other interrupts
+ *   HEALTH_STACK      fewer than HEALTH_STACK_MARGIN bytes between .bss
+ *                     and the deepest the stack has reached
+ *   HEALTH_REGISTERS  a timer, UART, INT0 or relay register no longer
+ *                     holds what its init function wrote
+ *   HEALTH_UART       TX data queued with its interrupt switched off
+ *
+ * health_init() paints the free RAM below the stack with HEALTH_CANARY
+ * before interrupts are enabled; the stack high-water mark is the first
+ * byte above .bss that lost the pattern. Everything except the tick check
+ * runs once every HEALTH_CHECK_INTERVAL. A foreground that hangs outright
+ * is still left to the watchdog.
+ */
+
+#define HEALTH_CANARY 0xC5
+#define HEALTH_STACK_MARGIN 16       // Fault below 16 never-used stack bytes
+#define HEALTH_MAX_IDLE_PASSES 1000  // Loop passes within one tick before the tick counts as dead
+#define HEALTH_CHECK_INTERVAL 1000   // 1 second between the slower checks
+
+#define HEALTH_OK 0
+#define HEALTH_TICK 1
+#define HEALTH_STACK 2
+#define HEALTH_REGISTERS 3
+#define HEALTH_UART 4
+#define HEALTH_STATE 5               // Detected by the caller, e.g. an impossible gate state
+
+void health_init(void);
+uint8_t health_poll(void);
+uint16_t health_stack_free(void);
+
+#endif
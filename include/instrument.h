@@ -0,0 +1,70 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "command.h"
+#include "config.h"
+
+/*
+ * Optional latency instrumentation.
+ *
+ * Build with -DINSTRUMENT_ENABLE=1 to timestamp four points against Timer1,
+ * extended to 32 bits of microseconds by its overflow interrupt: the INT0
+ * edge that starts a button press, the decision to act on a press or a
+ * command, the relay write that carries it out, and the start of every
+ * main loop pass. Three spans between them are accumulated in RAM:
+ *
+ *   INSTR_BUTTON  INT0 edge to decision, includes the press confirmation
+ *   INSTR_RELAY   decision to relays changed, a start includes the dead time
+ *   INSTR_LOOP    main loop start to the next start, one tick when on time
+ *
+ * Each keeps a count, min, max, mean and an 8-bin log2 histogram. Bin 0
+ * holds spans under 2^offset microseconds, bin i up to 2^(offset + i) and
+ * bin 7 everything longer, with the offset chosen per span to cover its
+ * range (button 16, relay 11, loop 7). The bins are single bytes to save
+ * RAM. When the count or a bin saturates, the count, sum and bins are all
+ * halved, so the mean and the shape of the histogram stay right; a busy
+ * span such as the loop then shows roughly its last few hundred samples.
+ *
+ * The CMD_INSTRUMENT reply holds each span in turn: count (16-bit), then
+ * min, max and mean (32-bit), then the bins (8-bit), all little-endian.
+ * Two bytes follow for the button event queue: presses dropped because it
+ * was full, and the longest any press waited in it in ms, both saturating
+ * at 255. A request payload byte of 1 clears all of it once it has been
+ * sent.
+ */
+
+#ifndef INSTRUMENT_ENABLE
+#define INSTRUMENT_ENABLE 0
+#endif
+
+#define INSTR_BUTTON 0
+#define INSTR_RELAY 1
+#define INSTR_LOOP 2
+#define INSTR_SPANS 3
+
+#define INSTR_BINS 8
+#define INSTR_REPLY_SIZE (INSTR_SPANS * (2 + 3 * 4 + INSTR_BINS) + 2)
+
+#if INSTRUMENT_ENABLE
+
+void instrument_init(void);
+void instrument_edge(void);
+void instrument_decision(bool from_button);
+void instrument_relays(void);
+void instrument_loop(void);
+void instrument_report(const command_t* cmd);
+
+#else
+
+static inline void instrument_init(void) {}
+static inline void instrument_edge(void) {}
+static inline void instrument_decision(bool from_button) { (void)from_button; }
+static inline void instrument_relays(void) {}
+static inline void instrument_loop(void) {}
+
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+#include "eeprom_layout.h"
+
+/*
+ * Wear-levelled state journal.
+ *
+ * Each change appends a fixed size record to the next slot of a ring that
+ * spans the journal region, so a given cell is only rewritten once per
+ * JOURNAL_SLOTS changes. A record carries an 8-bit sequence number and a
+ * CRC written last; a torn write simply fails the CRC and the previous
+ * record stays current. journal_init() finds the newest record in a single
+ * pass over the fixed number of slots. Records are written through the
+ * EEPROM queue, so journal_write() returns before the bytes are programmed.
+ *
+ * Bit 0 of the flags byte is JOURNAL_FLAG_RESET. Bits 1..7 hold how far the
+ * gate sits from the end its state rests at, see gate_store(), so records
+ * written before the offset existed read as resting at that end.
+ */
+
+#define JOURNAL_RECORD_SIZE 4
+#define JOURNAL_SLOTS ((EE_JOURNAL_END - EE_JOURNAL_START) / JOURNAL_RECORD_SIZE)
+
+#define JOURNAL_FLAG_RESET 0x01      // Set before a controlled reset
+#define JOURNAL_OFFSET_SHIFT 1       // Position offset in the remaining bits
+#define JOURNAL_OFFSET_MAX 127
+
+#define JOURNAL_EMPTY 0xFF           // journal_state() before anything was written
+
+#if JOURNAL_SLOTS > 128
+#error "Sequence numbers need a window of at most 128 slots"
+#endif
+
+void journal_init(void);
+uint8_t journal_state(void);
+uint8_t journal_flags(void);
+void journal_write(uint8_t state, uint8_t flags);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <avr/pgmspace.h>
+
+#include "telemetry.h"
+#include "uart.h"
+
+/*
+ * Levelled logging.
+ *
+ *   LOG_EVENT(level, evt, state, "text")  something a data logger cares about
+ *   LOG_TEXT(level, "text")               narration for the serial console
+ *
+ * level is one of ERROR, WARN, INFO or DEBUG. LOG_LEVEL (set from the
+ * Makefile, e.g. make LOG_LEVEL=WARN) picks the most verbose level that is
+ * compiled in. Calls above it expand to nothing, so neither the call nor
+ * its PROGMEM string reaches the flash image. In text builds both macros
+ * print; in TELEMETRY_BINARY builds LOG_EVENT() records a telemetry event
+ * and LOG_TEXT() is always dropped.
+ */
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_IF_ERROR(x) x
+#else
+#define LOG_IF_ERROR(x) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_IF_WARN(x) x
+#else
+#define LOG_IF_WARN(x) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_IF_INFO(x) x
+#else
+#define LOG_IF_INFO(x) ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_IF_DEBUG(x) x
+#else
+#define LOG_IF_DEBUG(x) ((void)0)
+#endif
+
+#if TELEMETRY_BINARY
+#define LOG_EMIT_EVENT(evt, state, text) telemetry_record((evt), (state))
+#define LOG_EMIT_TEXT(text) ((void)0)
+#else
+#define LOG_EMIT_EVENT(evt, state, text) uart_tx_string_P(PSTR(text))
+#define LOG_EMIT_TEXT(text) uart_tx_string_P(PSTR(text))
+#endif
+
+#define LOG_EVENT(level, evt, state, text) LOG_IF_##level(LOG_EMIT_EVENT(evt, state, text))
+#define LOG_TEXT(level, text) LOG_IF_##level(LOG_EMIT_TEXT(text))
+
+#endif
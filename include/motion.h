@@ -0,0 +1,199 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "pwm.h"
+
+/*
+ * Non-blocking motor motion state machine.
+ *
+ * motion_start() only arms the sequence; motion_poll() is called from the
+ * main loop every tick and walks through the states below, switching the
+ * H-bridge relays as each phase times out.
+ *
+ *   IDLE -> DEAD_TIME -> RUNNING -> BRAKING -> ARRIVED -> IDLE
+ *
+ * DEAD_TIME keeps every relay off before a direction is energized, BRAKING
+ * keeps them off while the contacts settle after the motor is released.
+ * motion_stop() cuts the relays at once and finishes through BRAKING
+ * without reporting ARRIVED. With current sensing enabled, RUNNING also
+ * ends early when the motor stalls against its endstop. If the hall sensor
+ * cut the relays, or the motor stalled where the travel estimate says the
+ * end is still ahead, motion_poll() returns MOTION_OBSTRUCTED once and the
+ * run finishes through BRAKING; MOTION_POWER_FAIL works the same way for
+ * the supply monitor.
+ *
+ * Built with RELAY_ECONOMY_ENABLE=1, an energized pair of relays gets full
+ * voltage for RELAY_PULL_IN_TIME and is then held by soft PWM from the tick
+ * interrupt, on for RELAY_HOLD_ON out of every RELAY_HOLD_PERIOD ticks. The
+ * flyback diodes carry the coil current through the off ticks, so the
+ * armatures stay closed while the 5V rail supplies only that duty of the
+ * coil and opto current.
+ *
+ * Built with LEAF_B_ENABLE=1, a second H-bridge on PORTC drives the other
+ * leaf of a double gate through the same sequence, with its own state. The
+ * leaves never start together, so their inrush currents never land on the
+ * shared supply at once: on open leaf A leads and leaf B follows after
+ * LEAF_OPEN_STAGGER_MS, on close leaf B leads and leaf A follows after
+ * LEAF_CLOSE_STAGGER_MS, so leaf A, which carries the overlap strip, shuts
+ * last over leaf B. The delay is simply added to the follower's dead time.
+ * Current sensing, the hall sensor and travel learning all watch leaf A;
+ * leaf B runs for the same time. ARRIVED is reported once both leaves have
+ * finished, and an obstruction or a stop halts both.
+ *
+ * Built with MOTOR_PWM_ENABLE=1, the relays switch with the MOSFET on OC1A
+ * off (see pwm.h). RUNNING soft-starts the motor; a stop, a reversal or
+ * the end of a run ramps it down in BRAKING or DEAD_TIME, and that phase
+ * only starts counting once the relays have opened. The LED for closing
+ * moves to PD7, and leaf B has no MOSFET of its own, so the two don't mix.
+ */
+
+#ifndef RELAY_ECONOMY_ENABLE
+#define RELAY_ECONOMY_ENABLE 0
+#endif
+
+#ifndef LEAF_B_ENABLE
+#define LEAF_B_ENABLE 0
+#endif
+
+#define LEAF_A 0
+#define LEAF_B 1
+#define MOTION_LEAVES (1 + LEAF_B_ENABLE)
+
+#ifndef RELAY_K1                     // H-bridge relays, all on PORTB
+#define RELAY_K1 PB0
+#define RELAY_K2 PB1
+#define RELAY_K3 PB2
+#define RELAY_K4 PB3
+#endif
+#ifndef LED_OPENING                  // Direction LEDs, both on PORTD
+#define LED_OPENING PD4
+#if MOTOR_PWM_ENABLE
+#define LED_CLOSING PD7              // PD5 is OC1A, the MOSFET gate
+#else
+#define LED_CLOSING PD5
+#endif
+#endif
+#define RELAY_MASK ((1 << RELAY_K1) | (1 << RELAY_K2) | (1 << RELAY_K3) | (1 << RELAY_K4))
+#ifndef RELAY_B_K1                   // Leaf B relays, all on PORTC
+#define RELAY_B_K1 PC0
+#define RELAY_B_K2 PC1
+#define RELAY_B_K3 PC2
+#define RELAY_B_K4 PC3
+#endif
+#define RELAY_B_MASK ((1 << RELAY_B_K1) | (1 << RELAY_B_K2) | (1 << RELAY_B_K3) | (1 << RELAY_B_K4))
+#define LED_MASK ((1 << LED_OPENING) | (1 << LED_CLOSING))
+
+#ifndef RELAY_SWITCHING_DELAY
+#if MOTOR_PWM_ENABLE
+#define RELAY_SWITCHING_DELAY 40     // The contacts carry no current, they only have to open
+#else
+#define RELAY_SWITCHING_DELAY 100    // 100ms delay between relay operations
+#endif
+#endif
+#define RELAY_SWITCHING_MIN 20       // Datasheet release time is 5ms, keep a wide margin
+#ifndef LEAF_OPEN_STAGGER_MS
+#define LEAF_OPEN_STAGGER_MS 1500    // Leaf B starts opening this long after leaf A
+#endif
+#ifndef LEAF_CLOSE_STAGGER_MS
+#define LEAF_CLOSE_STAGGER_MS 3000   // Leaf A starts closing this long after leaf B
+#endif
+#ifndef RELAY_PULL_IN_TIME
+#define RELAY_PULL_IN_TIME 50        // 50ms at full voltage before holding
+#endif
+#ifndef RELAY_HOLD_ON
+#define RELAY_HOLD_ON 1              // Coils on for 1 tick...
+#define RELAY_HOLD_PERIOD 2          // ...out of every 2, 50% duty at 500Hz
+#endif
+
+#if RELAY_K1 > 7 || RELAY_K2 > 7 || RELAY_K3 > 7 || RELAY_K4 > 7 || \
+    RELAY_K1 == RELAY_K2 || RELAY_K1 == RELAY_K3 || RELAY_K1 == RELAY_K4 || \
+    RELAY_K2 == RELAY_K3 || RELAY_K2 == RELAY_K4 || RELAY_K3 == RELAY_K4
+#error "RELAY_K1..RELAY_K4 must be four different PORTB bits"
+#endif
+
+// PC6 and PC7 are left for the Timer2 watch crystal
+#if LEAF_B_ENABLE && (RELAY_B_K1 > 5 || RELAY_B_K2 > 5 || RELAY_B_K3 > 5 || RELAY_B_K4 > 5 || \
+    RELAY_B_K1 == RELAY_B_K2 || RELAY_B_K1 == RELAY_B_K3 || RELAY_B_K1 == RELAY_B_K4 || \
+    RELAY_B_K2 == RELAY_B_K3 || RELAY_B_K2 == RELAY_B_K4 || RELAY_B_K3 == RELAY_B_K4)
+#error "RELAY_B_K1..RELAY_B_K4 must be four different bits of PC0..PC5"
+#endif
+
+#if LEAF_OPEN_STAGGER_MS > 65535 - RELAY_SWITCHING_DELAY || LEAF_CLOSE_STAGGER_MS > 65535 - RELAY_SWITCHING_DELAY
+#error "Leaf stagger plus dead time must fit in 16 bits"
+#endif
+
+#if LED_OPENING == LED_CLOSING || (LED_MASK & ((1 << PD0) | (1 << PD1) | (1 << PD2) | (1 << PD6))) || \
+    LED_OPENING > 7 || LED_CLOSING > 7
+#error "LED pins must be two different PORTD bits clear of the UART, INT0 and ICP1 pins"
+#endif
+
+#if MOTOR_PWM_ENABLE && (LED_MASK & (1 << PWM_PIN))
+#error "PD5 drives the MOSFET in PWM builds, move the LED off it"
+#endif
+
+#if MOTOR_PWM_ENABLE && LEAF_B_ENABLE
+#error "The PWM MOSFET only switches leaf A's bridge"
+#endif
+
+#if RELAY_SWITCHING_DELAY < RELAY_SWITCHING_MIN
+#error "RELAY_SWITCHING_DELAY is too short for the contacts to open before the bridge reverses"
+#endif
+
+#if RELAY_PULL_IN_TIME > 255 || RELAY_HOLD_ON >= RELAY_HOLD_PERIOD || RELAY_HOLD_PERIOD > 255
+#error "Relay economizer timing must fit in 8 bits and leave an off time"
+#endif
+
+#define MOTION_IDLE 0
+#define MOTION_DEAD_TIME 1
+#define MOTION_RUNNING 2
+#define MOTION_BRAKING 3
+#define MOTION_ARRIVED 4
+#define MOTION_OBSTRUCTED 5          // Event only, never a resting state
+#define MOTION_POWER_FAIL 6          // Event only, the supply monitor cut the relays
+
+#define MOTION_DIR_OPEN 0
+#define MOTION_DIR_CLOSE 1
+
+void motion_init(void);
+void motion_start(uint8_t direction, uint32_t run_ms);
+void motion_stop(void);
+uint8_t motion_poll(void);
+uint8_t motion_busy(void);
+bool motion_at_endstop(void);
+uint16_t motion_position(void);
+uint8_t motion_direction(void);
+
+#if RELAY_ECONOMY_ENABLE
+extern volatile uint8_t motion_relays_held[MOTION_LEAVES];
+void motion_tick(void);
+#else
+static inline void motion_tick(void) {}
+#endif
+
+// Drop every relay of every leaf at once; safe to call from interrupt context
+static inline void motion_cut_relays(void) {
+    pwm_cut();                       // The MOSFET opens before the contacts do
+#if RELAY_ECONOMY_ENABLE
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) motion_relays_held[i] = 0;
+#endif
+    PORTB &= ~RELAY_MASK;
+#if LEAF_B_ENABLE
+    PORTC &= ~RELAY_B_MASK;
+#endif
+}
+
+// Relay outputs of both bridges, leaf B in the high byte
+static inline uint16_t motion_relay_outputs(void) {
+#if LEAF_B_ENABLE
+    return (PORTB & RELAY_MASK) | ((uint16_t)(PORTC & RELAY_B_MASK) << 8);
+#else
+    return PORTB & RELAY_MASK;
+#endif
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <avr/sleep.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional power manager that waits in power-save instead of idle.
+ *
+ * The ATmega8535 has no system clock prescaler, so the clock can't be
+ * slowed down and the timer and baud settings never change. Instead,
+ * once the gate is at rest, the UART and the EEPROM queue have drained,
+ * the button is released and POWER_AWAKE_MS have passed since the last
+ * command or press, power_sleep() stops the 8MHz clock in power-save
+ * rather than idling between 1ms ticks. It needs the Timer2 watch crystal
+ * (see rtc.h), which keeps counting in power-save.
+ *
+ * The chip wakes on a low level on INT0 (the button) or INT1 (PD3, wired
+ * to RXD), the only kind of external interrupt that works without a
+ * clock, or on a Timer2 compare match POWER_SLEEP_COUNTS crystal counts
+ * after it went to sleep, which keeps the watchdog fed. Whatever runs
+ * first after the wake-up calls power_wake(): it puts INT0 back on any
+ * edge, and adds the time Timer2 counted while asleep to millis(), so the
+ * button ISR stamps the press on the right clock. Full speed is back after
+ * the oscillator start-up time (16K CK, 2ms, with the crystal fuses) and
+ * at most two crystal cycles (61us) spent to read Timer2.
+ *
+ * USART RX is not clocked in power-save, so whatever wakes the chip is
+ * lost, and INT1 only fires if RXD is still low once the clock runs. A
+ * host first sends 0x00 bytes for at least POWER_WAKE_MS (five at 9600
+ * baud), then its frame straight after; the controller stays awake for
+ * POWER_AWAKE_MS after each frame, so only the first of a burst needs it.
+ */
+
+#ifndef POWER_SAVE_ENABLE
+#define POWER_SAVE_ENABLE 0
+#endif
+
+#ifndef POWER_AWAKE_MS
+#define POWER_AWAKE_MS 2000UL        // Keep full speed this long after a command or press
+#endif
+#define POWER_SLEEP_COUNTS 128       // Timer2 counts per sleep, 0.5s, well inside the 1s watchdog
+#define POWER_WAKE_MS 5              // Hosts hold RXD low with 0x00 bytes this long to wake the chip
+#define POWER_RX_WAKE_PIN PD3        // INT1, wired to RXD (PD0)
+
+#if POWER_SLEEP_COUNTS < 2 || POWER_SLEEP_COUNTS > 255
+#error "POWER_SLEEP_COUNTS must wake the chip within one Timer2 cycle"
+#endif
+
+#if POWER_SAVE_ENABLE
+
+void power_init(void);
+void power_activity(void);
+void power_sleep(bool quiet);
+void power_wake(void);
+
+#else
+
+static inline void power_init(void) {}
+static inline void power_activity(void) {}
+static inline void power_sleep(bool quiet) { (void)quiet; sleep_mode(); }
+static inline void power_wake(void) {}
+
+#endif
+
+#endif
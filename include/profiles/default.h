@@ -0,0 +1,20 @@
+#ifndef PROFILE_DEFAULT_H
+#define PROFILE_DEFAULT_H
+
+/*
+ * Reference build: the values in the module headers, unchanged.
+ *
+ * Copy this file to start a site profile. The usual overrides are
+ *
+ *   F_CPU                  include/config.h
+ *   GATE_OPERATION_TIME    include/travel.h
+ *   RELAY_SWITCHING_DELAY  include/motion.h, with the relay and LED pins
+ *   BUTTON_DEBOUNCE_DELAY  include/button.h
+ *   COMMAND_NODE_ADDR      include/command.h
+ *
+ * and any of the optional features (CURRENT_SENSE_ENABLE and friends).
+ * Each feature costs SRAM, and the link fails once static data leaves
+ * less than STACK_RESERVE for the stack; the README lists what fits.
+ */
+
+#endif
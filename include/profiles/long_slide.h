@@ -0,0 +1,27 @@
+#ifndef PROFILE_LONG_SLIDE_H
+#define PROFILE_LONG_SLIDE_H
+
+/*
+ * Example site: a heavy sliding gate on a shared RS-485 bus.
+ *
+ * The stroke takes about 45 seconds, the larger contactor-style relays need
+ * longer to release before the motor is reversed, and the remote receiver
+ * output drops out for longer than a push button bounces. Endstops are
+ * found by current sensing and obstructions by the hall sensor on the
+ * pinion.
+ *
+ * The two sensors leave this profile only a few bytes under the SRAM
+ * budget the Makefile checks: the supply monitor or relay economy still
+ * fit, but INSTRUMENT_ENABLE, TELEMETRY_BINARY, LEAF_B_ENABLE and
+ * MOTOR_PWM_ENABLE do not.
+ */
+
+#define GATE_OPERATION_TIME 50000    // 45s stroke plus margin, until learned
+#define RELAY_SWITCHING_DELAY 200    // Slower relays need more dead time
+#define BUTTON_GAP_MS 30             // Remote receiver output chatters
+
+#define COMMAND_NODE_ADDR 0x03
+#define CURRENT_SENSE_ENABLE 1
+#define HALL_SENSOR_ENABLE 1
+
+#endif
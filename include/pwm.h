@@ -0,0 +1,105 @@
+#ifndef PWM_H
+#define PWM_H
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional soft-start / soft-stop drive through a low-side MOSFET on OC1A.
+ *
+ * With MOTOR_PWM_ENABLE the relays only select the direction: the bridge's
+ * ground return runs through a logic-level N-MOSFET whose gate is driven
+ * from OC1A (PD5), with a freewheel diode from its drain back to the 19V
+ * rail. motion.c closes the relays with the MOSFET off, waits
+ * MOTOR_RELAY_SETTLE_MS for the contacts to stop bouncing, then ramps the
+ * duty from MOTOR_RAMP_START_DUTY to full over MOTOR_RAMP_UP_MS. A stop or
+ * a reversal ramps it back down over MOTOR_RAMP_DOWN_MS and an endstop
+ * cuts it at once, and the relays only open MOTOR_CURRENT_DECAY_MS after
+ * the MOSFET has, once the freewheel current has died away. The contacts
+ * never make or break the motor current.
+ *
+ * Timer1 keeps free-running at 1MHz for the hall sensor and the latency
+ * instrumentation, so the PWM isn't one of Timer1's PWM modes: OC1A is set
+ * and cleared by compare matches, and TIMER1_COMPA_vect schedules the next
+ * edge, two interrupts per MOTOR_PWM_PERIOD_US. The edges themselves are
+ * made by the timer, so interrupt latency only shortens or stretches a
+ * pulse when it outlasts one, and then FOC1A makes the late edge at once.
+ * The interrupt only runs during a ramp; at full and zero duty OC1A is
+ * disconnected and PD5 is a plain output.
+ *
+ * The hall and supply interrupts cut the MOSFET with the relays, through
+ * motion_cut_relays(). The MOSFET needs a gate pull-down, so it stays off
+ * while PD5 is an input during reset.
+ *
+ * MOTOR_RAMP_PROFILE picks the shape of both ramps: MOTOR_RAMP_LINEAR, or
+ * MOTOR_RAMP_S_CURVE, which eases in and out of each end (smoothstep) for
+ * the least jerk on a heavy leaf.
+ */
+
+#ifndef MOTOR_PWM_ENABLE
+#define MOTOR_PWM_ENABLE 0
+#endif
+
+#define MOTOR_RAMP_LINEAR 0
+#define MOTOR_RAMP_S_CURVE 1
+
+#ifndef MOTOR_RAMP_PROFILE
+#define MOTOR_RAMP_PROFILE MOTOR_RAMP_S_CURVE
+#endif
+#ifndef MOTOR_RAMP_UP_MS
+#define MOTOR_RAMP_UP_MS 600         // Start duty to full
+#endif
+#ifndef MOTOR_RAMP_DOWN_MS
+#define MOTOR_RAMP_DOWN_MS 400       // Full back to the start duty, then off
+#endif
+#ifndef MOTOR_RAMP_START_DUTY
+#define MOTOR_RAMP_START_DUTY 64     // Out of PWM_FULL, about where the motor breaks away
+#endif
+#define MOTOR_RELAY_SETTLE_MS 15     // Datasheet operate time is 10ms, plus bounce
+#define MOTOR_CURRENT_DECAY_MS 10    // Freewheel current gone before the contacts open
+#define MOTOR_PWM_PERIOD_US 250      // 4kHz
+#define MOTOR_PWM_MIN_US 20          // Shortest pulse, either level; a shorter one rounds off
+
+#define PWM_PIN PD5                  // OC1A
+#define PWM_FULL 255
+
+#if MOTOR_RAMP_PROFILE != MOTOR_RAMP_LINEAR && MOTOR_RAMP_PROFILE != MOTOR_RAMP_S_CURVE
+#error "MOTOR_RAMP_PROFILE must be MOTOR_RAMP_LINEAR or MOTOR_RAMP_S_CURVE"
+#endif
+
+#if MOTOR_RAMP_UP_MS < 1 || MOTOR_RAMP_UP_MS > 10000 || MOTOR_RAMP_DOWN_MS < 1 || MOTOR_RAMP_DOWN_MS > 10000
+#error "Motor ramps must take between 1ms and 10s"
+#endif
+
+#if MOTOR_RAMP_START_DUTY < 1 || MOTOR_RAMP_START_DUTY >= PWM_FULL
+#error "MOTOR_RAMP_START_DUTY must be between 1 and PWM_FULL - 1"
+#endif
+
+#if MOTOR_PWM_PERIOD_US < 4 * MOTOR_PWM_MIN_US || MOTOR_PWM_PERIOD_US > 10000
+#error "MOTOR_PWM_PERIOD_US must leave room for ramp steps and fit the 16-bit Timer1 range"
+#endif
+
+#if MOTOR_PWM_ENABLE
+
+void pwm_init(void);
+void pwm_set(uint8_t duty);
+uint8_t pwm_duty(void);
+uint8_t pwm_ramp(uint8_t from, uint8_t to, uint32_t elapsed_ms, uint16_t ramp_ms);
+
+// MOSFET off at once; safe to call from interrupt context
+static inline void pwm_cut(void) {
+    TIMSK &= ~(1 << OCIE1A);
+    PORTD &= ~(1 << PWM_PIN);
+    TCCR1A = 0;
+}
+
+#else
+
+static inline void pwm_init(void) {}
+static inline void pwm_cut(void) {}
+
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <avr/io.h>
+
+#include "auto_close.h"
+#include "config.h"
+#include "power.h"
+
+/*
+ * Timer2 as a real-time clock, counted from a 32.768kHz watch crystal.
+ *
+ * Timer2 runs asynchronously from the crystal on TOSC1/TOSC2 (PC6/PC7).
+ * Divided by 128 it counts RTC_HZ times a second and overflows once a
+ * second, whatever the system clock does and in every sleep mode down to
+ * power-save. Auto-close and the power manager share it: auto_close.c
+ * owns the overflow interrupt and power.c the compare match.
+ *
+ * Writes to TCNT2, OCR2 and TCCR2 only reach the timer after a couple of
+ * crystal cycles; rtc_settle() waits for them.
+ */
+
+#define RTC_ENABLE (AUTO_CLOSE_ENABLE || POWER_SAVE_ENABLE)
+
+#define RTC_HZ 256                   // Timer2 counts per second
+#define RTC_TIMER2_CONTROL ((1 << CS22) | (1 << CS20)) // 32768Hz / 128, overflow at 1Hz
+
+#if RTC_ENABLE
+
+void rtc_init(void);
+void rtc_settle(void);
+
+#else
+
+static inline void rtc_init(void) {}
+
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include "command.h"
+#include "eeprom_layout.h"
+
+/*
+ * Relay and motor cycle counters for predictive maintenance.
+ *
+ * The motion state machine counts in RAM as it switches the H-bridges,
+ * which costs an increment per event and nothing else:
+ *
+ *   actuations  per leaf and direction. The two relays of a pair (K1/K4
+ *               to open, K2/K3 to close) always switch together, so one
+ *               count covers both coils
+ *   run time    seconds leaf A's motor was powered, per direction
+ *   stops       runs cut short by motion_stop()
+ *   stalls      runs where the motor stopped turning short of the end of
+ *               travel, i.e. hall obstructions and current-sense stalls
+ *               the travel estimate doesn't place at an endstop
+ *
+ * The counters reach EEPROM in batches: once the gate has rested for
+ * STATS_FLUSH_IDLE_MS after a change, and before a controlled reset. Not
+ * when the supply monitor cuts a run: a batch takes about 200ms of
+ * writes, far longer than the PSU's hold-up, and would only hold up the
+ * journal record queued behind it. A batch rewrites the older of two
+ * STATS_RECORD_SIZE copies with a sequence number and a CRC-8 written
+ * last, so one torn by a power cut leaves the previous batch in place.
+ * Counts since the last batch are lost on any other reset. At one batch
+ * per gate cycle each cell is written every other cycle, and the queue
+ * skips the bytes that have not changed.
+ *
+ * EEPROM keeps every count in 24 bits, and the counters stop there.
+ *
+ * The CMD_STATS reply holds the live counters, little-endian: actuations
+ * (32-bit) to open and to close for leaf A, then the same for leaf B,
+ * zero in single-leaf builds; run seconds (32-bit) opening, then closing;
+ * stops and stalls (16-bit). A request payload byte of 1 clears them once
+ * they have been sent, e.g. after the relays have been replaced.
+ */
+
+#ifndef STATS_FLUSH_IDLE_MS
+#define STATS_FLUSH_IDLE_MS 60000UL  // Rest this long after a change before writing a batch
+#endif
+
+#define STATS_LEAVES 2               // The record always has room for leaf B
+#define STATS_RECORD_SIZE 24
+#define STATS_COPIES ((EE_STATS_END - EE_STATS_START) / STATS_RECORD_SIZE)
+#define STATS_REPLY_SIZE (STATS_LEAVES * 2 * 4 + 2 * 4 + 2 * 2)
+
+#if STATS_COPIES != 2
+#error "The stats region must hold exactly two records"
+#endif
+
+void stats_init(void);
+void stats_actuation(uint8_t leaf, uint8_t direction);
+void stats_run(uint8_t direction, uint32_t run_ms);
+void stats_stop(void);
+void stats_stall(void);
+void stats_poll(void);
+void stats_flush(void);
+void stats_report(const command_t* cmd);
+
+#endif
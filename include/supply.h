@@ -0,0 +1,80 @@
+#ifndef SUPPLY_H
+#define SUPPLY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Optional supply monitor that saves the gate position before a brown-out.
+ *
+ * A divider from the 5V rail feeds ADC1 (PA1). While any relay is powered
+ * the shared ADC samples it alongside the current shunt, and
+ * SUPPLY_SAG_CONFIRM samples in a row below SUPPLY_SAG_MV mean the supply
+ * is going away. ADC_vect then cuts every relay, which leaves the rail
+ * carrying little more than the MCU, and hands one byte to
+ * ee_queue_urgent(): the direction of the run and how far along its stroke
+ * leaf A had got, to within TRAVEL_POS_OPEN / SUPPLY_RECORD_STEPS.
+ * EE_RDY_vect programs it ahead of everything queued, once any byte the
+ * queue has started is done, so the PSU's hold-up below SUPPLY_SAG_MV has
+ * to cover two programming times (about 17ms) before the brown-out
+ * detector holds the chip in reset.
+ *
+ * On boot a record sets the state the run was heading for, as a button
+ * stop would have, and the saved position, where the journal alone could
+ * only give the last resting state and its end of travel. If the supply
+ * recovers instead, the foreground stops the run through the gate state
+ * machine. Either way the record stays valid until the gate next moves and
+ * motion_start() calls supply_forget(), which erases it through the same
+ * slot, so an erase never lands after the record of a later sag.
+ */
+
+#ifndef SUPPLY_MONITOR_ENABLE
+#define SUPPLY_MONITOR_ENABLE 0
+#endif
+
+#define SUPPLY_CHANNEL 1             // ADC1 / PA1
+#ifndef SUPPLY_SAG_MV
+#define SUPPLY_SAG_MV 4500           // Well above the 4.0V brown-out level
+#endif
+#define SUPPLY_DIVIDER_TOP_K 12      // 12k from the 5V rail to PA1...
+#define SUPPLY_DIVIDER_BOTTOM_K 10   // ...and 10k from PA1 to GND
+#define SUPPLY_SAG_CONFIRM 4         // Consecutive low samples, rides out relay pull-in dips
+#define SUPPLY_ADC_REF_MV 2560UL
+
+// PA1 reads this many counts with the rail at `mv`
+#define SUPPLY_COUNTS(mv) ((mv) * 1024UL * SUPPLY_DIVIDER_BOTTOM_K / \
+    (SUPPLY_ADC_REF_MV * (SUPPLY_DIVIDER_TOP_K + SUPPLY_DIVIDER_BOTTOM_K)))
+#define SUPPLY_SAG_COUNTS SUPPLY_COUNTS(SUPPLY_SAG_MV)
+
+#define SUPPLY_RECORD_NONE 0xFF      // Erased EEPROM, no run was cut short
+#define SUPPLY_RECORD_OPENING 0x80   // Set when the run was opening
+#define SUPPLY_RECORD_STEPS 125      // Position in the low 7 bits, 0..SUPPLY_RECORD_STEPS
+
+#if SUPPLY_SAG_COUNTS >= 1023 || SUPPLY_COUNTS(5000) >= 1023
+#error "SUPPLY_SAG_MV and the nominal 5V must both read below full scale through the divider"
+#endif
+
+#if SUPPLY_MONITOR_ENABLE
+
+void supply_init(void);
+void supply_start(void);
+void supply_stop(void);
+void supply_forget(void);
+bool supply_sagged(void);
+bool supply_recover(uint8_t* direction, uint16_t* position);
+void supply_sample(uint16_t value);
+
+#else
+
+static inline void supply_init(void) {}
+static inline void supply_start(void) {}
+static inline void supply_stop(void) {}
+static inline void supply_forget(void) {}
+static inline bool supply_sagged(void) { return false; }
+static inline bool supply_recover(uint8_t* direction, uint16_t* position) { return false; }
+
+#endif
+
+#endif
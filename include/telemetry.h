@@ -0,0 +1,63 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Binary telemetry events.
+ *
+ * With TELEMETRY_BINARY = 1 the log strings are not compiled in at all (see
+ * log.h): LOG_TEXT() disappears, and LOG_EVENT() appends a 3-byte record to
+ * a RAM ring that the logger drains with the CMD_EVENTS command. Nothing is
+ * ever sent unsolicited, so a bus full of gates stays quiet until polled.
+ *
+ * Record layout:
+ *
+ *   byte 0   event id (bits 7..3) | gate state (bits 2..0)
+ *   byte 1-2 uptime in seconds, little-endian, wraps after ~18 hours
+ *
+ * The CMD_EVENTS reply payload is one byte counting records lost to
+ * overflow since the last poll, followed by up to TELEMETRY_MAX_PER_REPLY
+ * records, oldest first. The frame CRC covers all of it.
+ */
+
+#ifndef TELEMETRY_BINARY
+#define TELEMETRY_BINARY 0
+#endif
+
+#define TELEMETRY_QUEUE_SIZE 16      // Must be a power of two
+#define TELEMETRY_MAX_PER_REPLY 16
+#define TELEMETRY_RECORD_SIZE 3
+
+#define EVT_BOOT 1
+#define EVT_READY 2
+#define EVT_RESET_WATCHDOG 3
+#define EVT_RESET_POWER_ON 4
+#define EVT_RESET_EXTERNAL 5
+#define EVT_RESET_BROWN_OUT 6
+#define EVT_RESET_RECOVERED 7
+// 8 was the scheduled idle reset; left unused so logged ids keep their meaning
+#define EVT_RESET_CONTROLLED 9
+#define EVT_STATE 10
+#define EVT_TOGGLE_OPEN 11
+#define EVT_TOGGLE_CLOSE 12
+#define EVT_COMMAND_OPEN 13
+#define EVT_COMMAND_CLOSE 14
+#define EVT_EMERGENCY_STOP 15
+#define EVT_TRAVEL_ELAPSED 16
+#define EVT_ENDSTOP 17
+#define EVT_OBSTRUCTION 18
+#define EVT_MOTION_START 19
+#define EVT_HEALTH_FAULT 20
+#define EVT_BUTTON_NOISE 21
+#define EVT_POWER_FAIL 22
+#define EVT_AUTO_CLOSE 23
+
+#if TELEMETRY_BINARY
+void telemetry_record(uint8_t evt, uint8_t state);
+uint8_t telemetry_drain(uint8_t* out, uint8_t max_records);
+#endif
+
+#endif
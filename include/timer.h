@@ -0,0 +1,54 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * System timebase for the gate controller.
+ *
+ * Timer0 runs in CTC mode and raises TIMER0_COMP_vect once per millisecond.
+ * Everything that needs to know how long something took reads millis() or
+ * micros() instead of counting _delay_ms() calls, so time spent in UART
+ * output, relay switching or interrupts is never lost.
+ *
+ * Timer1 free-runs at F_CPU/8 (1MHz at 8MHz) as a 16-bit microsecond
+ * reference for input capture and interval measurement.
+ */
+
+#define TIMER_TICK_HZ 1000UL                // 1ms system tick
+#define TIMER0_PRESCALER 64UL
+#define TIMER0_TOP ((F_CPU / TIMER0_PRESCALER / TIMER_TICK_HZ) - 1)
+#define TIMER0_US_PER_COUNT (TIMER0_PRESCALER * 1000000UL / F_CPU)
+
+#define TIMER0_CONTROL ((1 << WGM01) | (1 << CS01) | (1 << CS00)) // CTC, clk/64
+
+#define TIMER1_PRESCALER 8UL
+#define TIMER1_CLOCK (1 << CS11)            // Normal mode, clk/8
+#define TIMER1_CLOCK_MASK ((1 << CS12) | (1 << CS11) | (1 << CS10))
+
+#if F_CPU / TIMER1_PRESCALER != 1000000UL
+#error "Timer1 counts are treated as microseconds, adjust TIMER1_PRESCALER for this F_CPU"
+#endif
+
+#if F_CPU % (TIMER0_PRESCALER * TIMER_TICK_HZ) != 0
+#error "F_CPU does not divide into an exact 1ms Timer0 tick"
+#endif
+
+#if TIMER0_TOP > 255
+#error "Timer0 tick does not fit in 8 bits, increase TIMER0_PRESCALER"
+#endif
+
+void timer_init(void);
+uint32_t millis(void);
+uint32_t micros(void);
+void timer_advance(uint32_t ms);
+
+// True once `duration_ms` has passed since `start_ms`. Safe across the 49 day wrap.
+static inline uint8_t timer_elapsed(uint32_t start_ms, uint32_t duration_ms) {
+    return (uint32_t)(millis() - start_ms) >= duration_ms;
+}
+
+#endif
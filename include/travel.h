@@ -0,0 +1,70 @@
+#ifndef TRAVEL_H
+#define TRAVEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Learned travel time and estimated gate position.
+ *
+ * The position is tracked as the fraction of a full stroke the gate is
+ * open, from 0 (closed) to TRAVEL_POS_OPEN (open), by integrating the time
+ * the motor actually ran in each direction against the learned open and
+ * close durations. A command then only drives for the distance that is
+ * left, plus a margin so the gate still reaches its endstop.
+ *
+ * A full stroke that ends on the current-sense endstop replaces the
+ * learned duration for that direction with the measured one, and any run
+ * that ends on an endstop snaps the estimate to that end. Learned times
+ * are kept in EEPROM and only rewritten when they move by more than
+ * TRAVEL_SAVE_DELTA_MS.
+ *
+ * Runs are only powered for the learned time plus a margin, so a gate
+ * that slows down past it, with cold grease or wind load, would never
+ * reach an endstop to relearn from. When a sensed run times out instead,
+ * travel_timed_out() lets runs that way go on to GATE_OPERATION_TIME
+ * until one has been learned from the endstop it finds there. A run that
+ * starts from an end a timeout only assumed isn't learned.
+ *
+ * travel_at_end() tells a motor that stopped turning at its endstop from
+ * one that was obstructed, for sensors such as the hall input that only
+ * see the gate stop. It needs a learned time: a direction that hasn't been
+ * learned borrows the other direction's. While neither has been learned,
+ * on a new unit or after the record was lost, every stop is the endstop,
+ * as it was before travel was learned at all, and the first plausible
+ * full stroke becomes that direction's time. The stroke after it is then
+ * judged against it, so only the very first stroke can't tell an
+ * obstruction from the end.
+ */
+
+#define TRAVEL_POS_CLOSED 0
+#define TRAVEL_POS_OPEN 1000
+
+#ifndef GATE_OPERATION_TIME
+#define GATE_OPERATION_TIME 30000    // 30 seconds for gate to fully open/close, until learned
+#endif
+#define TRAVEL_MIN_MS 3000           // Reject learned times shorter than this
+#define TRAVEL_OVERRUN_MS 2000       // Always drive this much past the estimated end
+#define TRAVEL_SAVE_DELTA_MS 200     // Rewrite EEPROM only for changes larger than this
+#define TRAVEL_END_WINDOW 100        // A stop this close to the end (of TRAVEL_POS_OPEN) is the endstop
+
+#if GATE_OPERATION_TIME <= TRAVEL_MIN_MS || GATE_OPERATION_TIME > 65535
+#error "GATE_OPERATION_TIME must be longer than TRAVEL_MIN_MS and fit the 16-bit learned times"
+#endif
+
+void travel_init(void);
+uint32_t travel_run_time(uint8_t direction);
+void travel_moved(uint8_t direction, uint32_t run_ms, bool endstop);
+void travel_timed_out(uint8_t direction);
+void travel_set_end(uint8_t at_open);
+void travel_set_position(uint16_t position);
+void travel_set_slack(int16_t slack);
+uint16_t travel_position(void);
+uint16_t travel_position_after(uint8_t direction, uint32_t run_ms);
+uint16_t travel_time(uint8_t direction);
+bool travel_learned(uint8_t direction);
+bool travel_at_end(uint8_t direction, uint32_t run_ms);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef UART_H
+#define UART_H
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+/*
+ * Interrupt-driven UART.
+ *
+ * uart_tx_char() and friends copy into a ring buffer and return at once;
+ * USART_UDRE_vect moves one byte per data-register-empty interrupt onto
+ * the wire. One main loop pass can log more than the ring holds: an
+ * emergency stop, the interrupted run and the new state come to
+ * UART_TX_BURST_MAX bytes, 130ms on the wire. So uart_tx_string_P() only
+ * copies what fits and parks the rest of the line, and up to UART_TX_LINES
+ * more behind it, as PROGMEM pointers; uart_poll() in the main loop moves
+ * them on as the ring drains. A line that finds the parking full is
+ * dropped whole and counted in uart_tx_dropped, so a log line arrives
+ * complete or not at all, and the loop never waits. That costs two bytes
+ * a line instead of doubling the ring.
+ *
+ * With UART_TX_BLOCK_WHEN_FULL = 1 the writer waits for space instead,
+ * which relies on the UDRE interrupt, so it must not be used with
+ * interrupts disabled, and needs a ring of UART_TX_BURST_MAX so that the
+ * loop never waits on a burst. uart_tx_char() and uart_tx_string() write
+ * bytes from RAM, which cannot be parked: they drop what does not fit, or
+ * wait in blocking mode. uart_tx_char_wait() always waits, for replies
+ * that must arrive whole.
+ *
+ * Received bytes are stored by USART_RX_vect in a second ring buffer and
+ * read with uart_rx_read(). Bytes with a framing error are discarded;
+ * bytes arriving while the ring is full are counted in uart_rx_dropped.
+ */
+
+#define BAUD 9600
+#define UBRR_VALUE ((F_CPU / (16UL * BAUD)) - 1)
+#define UART_CONTROL ((1 << RXEN) | (1 << TXEN) | (1 << RXCIE))
+#define UART_BAUD_ACTUAL (F_CPU / (16UL * (UBRR_VALUE + 1)))
+
+#if UART_BAUD_ACTUAL * 100 < BAUD * 98 || UART_BAUD_ACTUAL * 100 > BAUD * 102
+#error "F_CPU gives a baud rate more than 2% off BAUD"
+#endif
+
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE 64       // Must be a power of two, holds one less
+#endif
+#define UART_TX_MASK (UART_TX_BUFFER_SIZE - 1)
+#define UART_TX_BURST_MAX 124        // Longest log output of one main loop pass
+
+#define UART_TX_LINES 4              // Parked PROGMEM lines, a power of two
+#define UART_TX_LINES_MASK (UART_TX_LINES - 1)
+
+#ifndef UART_TX_BLOCK_WHEN_FULL
+#define UART_TX_BLOCK_WHEN_FULL 0
+#endif
+
+#define UART_RX_BUFFER_SIZE 16       // Must be a power of two
+#define UART_RX_MASK (UART_RX_BUFFER_SIZE - 1)
+
+#if (UART_TX_BUFFER_SIZE & UART_TX_MASK) || UART_TX_BUFFER_SIZE > 256
+#error "UART_TX_BUFFER_SIZE must be a power of two no larger than 256"
+#endif
+
+#if UART_TX_BLOCK_WHEN_FULL && UART_TX_BUFFER_SIZE - 1 < UART_TX_BURST_MAX
+#error "A blocking UART_TX_BUFFER_SIZE must hold UART_TX_BURST_MAX or the main loop stalls"
+#endif
+
+#if UART_TX_LINES & UART_TX_LINES_MASK
+#error "UART_TX_LINES must be a power of two"
+#endif
+
+#if (UART_RX_BUFFER_SIZE & UART_RX_MASK) || UART_RX_BUFFER_SIZE > 256
+#error "UART_RX_BUFFER_SIZE must be a power of two no larger than 256"
+#endif
+
+extern volatile uint8_t uart_rx_dropped;
+
+#if !UART_TX_BLOCK_WHEN_FULL
+extern volatile uint16_t uart_tx_dropped;   // Lines and lone bytes
+#endif
+
+void uart_init(void);
+void uart_tx_char(char c);
+void uart_tx_char_wait(char c);
+void uart_tx_string(const char* str);
+void uart_tx_string_P(const char* str);
+uint8_t uart_tx_idle(void);
+bool uart_tx_done(void);
+uint8_t uart_tx_free(void);
+bool uart_tx_stalled(void);
+void uart_poll(void);
+void uart_flush(void);
+uint8_t uart_rx_available(void);
+uint8_t uart_rx_read(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+/* Host-side stand-in for <avr/eeprom.h>, backed by the simulated EEPROM. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END 0x1FF
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#define eeprom_is_ready() (!(EECR & (1 << EEWE)))
+#define eeprom_busy_wait() do {} while (!eeprom_is_ready())
+
+#endif
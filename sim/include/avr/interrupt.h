@@ -0,0 +1,38 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+/*
+ * Host-side stand-in for <avr/interrupt.h>.
+ *
+ * ISR(vector) defines an ordinary function that sim/sim.c calls when the
+ * corresponding simulated peripheral raises its flag. Interrupts are only
+ * taken while the firmware sleeps or spins in hal_spin(), which is one of
+ * the interleavings real hardware allows.
+ */
+
+#include <stdint.h>
+
+extern volatile uint8_t sim_sreg_i;
+
+#define sei() (sim_sreg_i = 1)
+#define cli() (sim_sreg_i = 0)
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+void INT0_vect(void);
+void INT1_vect(void);
+void TIMER0_COMP_vect(void);
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER2_OVF_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+void ADC_vect(void);
+void EE_RDY_vect(void);
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+/*
+ * Host-side stand-in for <avr/io.h> (ATmega8535 subset).
+ *
+ * Every I/O register the firmware touches is a plain variable owned by
+ * sim/sim.c, so the register-level code compiles unchanged on the host.
+ *
+ * A few registers have side effects a variable cannot express:
+ *  - UDR, TIFR and GIFR are 16 bits wide. The simulator parks bit 8 set
+ *    in them, so any 8-bit store by the firmware shows up as a write,
+ *    even when it stores the value already there.
+ *  - EECR and EEDR go through sim_eeprom_reg(), which carries out the
+ *    EERE/EEMWE/EEWE strobes of the previous access first.
+ *  - TCCR1A goes through sim_timer1_reg() the same way, for FOC1A.
+ */
+
+#include <stdint.h>
+
+#define SIM_REG8(name)  extern volatile uint8_t name
+#define SIM_REG16(name) extern volatile uint16_t name
+
+SIM_REG8(PORTA); SIM_REG8(DDRA); SIM_REG8(PINA);
+SIM_REG8(PORTB); SIM_REG8(DDRB); SIM_REG8(PINB);
+SIM_REG8(PORTC); SIM_REG8(DDRC); SIM_REG8(PINC);
+SIM_REG8(PORTD); SIM_REG8(DDRD); SIM_REG8(PIND);
+
+SIM_REG16(UDR); SIM_REG8(UCSRA); SIM_REG8(UCSRB); SIM_REG8(UCSRC);
+SIM_REG8(UBRRH); SIM_REG8(UBRRL);
+
+SIM_REG8(GICR); SIM_REG16(GIFR); SIM_REG8(MCUCR); SIM_REG8(MCUCSR);
+SIM_REG8(TIMSK); SIM_REG16(TIFR); SIM_REG8(SFIOR);
+
+SIM_REG8(TCCR0); SIM_REG8(TCNT0); SIM_REG8(OCR0);
+SIM_REG8(sim_tccr1a); SIM_REG8(TCCR1B);
+SIM_REG16(TCNT1); SIM_REG16(OCR1A); SIM_REG16(OCR1B); SIM_REG16(ICR1);
+SIM_REG8(TCCR2); SIM_REG8(TCNT2); SIM_REG8(OCR2); SIM_REG8(ASSR);
+
+SIM_REG8(ADMUX); SIM_REG8(ADCSRA); SIM_REG16(ADC); SIM_REG8(ACSR);
+
+SIM_REG16(EEAR); SIM_REG8(sim_eedr); SIM_REG8(sim_eecr);
+volatile uint8_t *sim_eeprom_reg(volatile uint8_t *reg);
+#define EEDR (*sim_eeprom_reg(&sim_eedr))
+#define EECR (*sim_eeprom_reg(&sim_eecr))
+volatile uint8_t *sim_timer1_reg(volatile uint8_t *reg);
+#define TCCR1A (*sim_timer1_reg(&sim_tccr1a))
+SIM_REG8(WDTCR);
+SIM_REG16(SP);
+
+#define RAMEND 0x25F
+
+/* Port bits */
+#define PA0 0
+#define PA1 1
+#define PA2 2
+#define PA3 3
+#define PA4 4
+#define PA5 5
+#define PA6 6
+#define PA7 7
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+/* UCSRA */
+#define RXC  7
+#define TXC  6
+#define UDRE 5
+#define FE   4
+#define DOR  3
+#define PE   2
+#define U2X  1
+#define MPCM 0
+/* UCSRB */
+#define RXCIE 7
+#define TXCIE 6
+#define UDRIE 5
+#define RXEN  4
+#define TXEN  3
+#define UCSZ2 2
+#define RXB8  1
+#define TXB8  0
+/* UCSRC */
+#define URSEL 7
+#define UMSEL 6
+#define UPM1  5
+#define UPM0  4
+#define USBS  3
+#define UCSZ1 2
+#define UCSZ0 1
+#define UCPOL 0
+
+/* GICR / GIFR */
+#define INT1  7
+#define INT0  6
+#define INT2  5
+#define INTF1 7
+#define INTF0 6
+#define INTF2 5
+/* MCUCR */
+#define SM2   7
+#define SE    6
+#define SM1   5
+#define SM0   4
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+/* MCUCSR */
+#define ISC2  6
+#define WDRF  3
+#define BORF  2
+#define EXTRF 1
+#define PORF  0
+
+/* TIMSK / TIFR */
+#define OCIE2  7
+#define TOIE2  6
+#define TICIE1 5
+#define OCIE1A 4
+#define OCIE1B 3
+#define TOIE1  2
+#define OCIE0  1
+#define TOIE0  0
+#define OCF2   7
+#define TOV2   6
+#define ICF1   5
+#define OCF1A  4
+#define OCF1B  3
+#define TOV1   2
+#define OCF0   1
+#define TOV0   0
+
+/* TCCR0 */
+#define FOC0  7
+#define WGM00 6
+#define COM01 5
+#define COM00 4
+#define WGM01 3
+#define CS02  2
+#define CS01  1
+#define CS00  0
+/* TCCR1A */
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define FOC1A  3
+#define FOC1B  2
+#define WGM11  1
+#define WGM10  0
+/* TCCR1B */
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12  2
+#define CS11  1
+#define CS10  0
+/* TCCR2 */
+#define FOC2  7
+#define WGM20 6
+#define COM21 5
+#define COM20 4
+#define WGM21 3
+#define CS22  2
+#define CS21  1
+#define CS20  0
+/* ASSR */
+#define AS2    3
+#define TCN2UB 2
+#define OCR2UB 1
+#define TCR2UB 0
+
+/* ADMUX */
+#define REFS1 7
+#define REFS0 6
+#define ADLAR 5
+#define MUX4  4
+#define MUX3  3
+#define MUX2  2
+#define MUX1  1
+#define MUX0  0
+/* ADCSRA */
+#define ADEN  7
+#define ADSC  6
+#define ADATE 5
+#define ADIF  4
+#define ADIE  3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+/* SFIOR */
+#define ADTS2 7
+#define ADTS1 6
+#define ADTS0 5
+#define ACME  3
+#define PUD   2
+#define PSR2  1
+#define PSR10 0
+/* ACSR */
+#define ACD   7
+#define ACBG  6
+#define ACO   5
+#define ACI   4
+#define ACIE  3
+#define ACIC  2
+#define ACIS1 1
+#define ACIS0 0
+
+/* EECR */
+#define EERIE 3
+#define EEMWE 2
+#define EEWE  1
+#define EERE  0
+
+/* WDTCR */
+#define WDCE 4
+#define WDE  3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+
+#define _BV(bit) (1 << (bit))
+
+#endif
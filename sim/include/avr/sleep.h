@@ -0,0 +1,26 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+/*
+ * Host-side stand-in for <avr/sleep.h>.
+ *
+ * sleep_cpu() is where simulated time advances: it runs the scenario and
+ * the pending peripheral interrupts up to the next wake-up source.
+ */
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_PWR_DOWN (1 << 5)
+#define SLEEP_MODE_PWR_SAVE ((1 << 5) | (1 << 4))
+#define SLEEP_MODE_STANDBY  ((1 << 7) | (1 << 5))
+
+void sim_sleep_cpu(void);
+
+#define set_sleep_mode(mode) (MCUCR = (MCUCR & ~((1 << 7) | (1 << 5) | (1 << 4))) | (mode))
+#define sleep_enable()  (MCUCR |= (1 << 6))
+#define sleep_disable() (MCUCR &= ~(1 << 6))
+#define sleep_cpu()     sim_sleep_cpu()
+#define sleep_mode()    do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+/*
+ * Host-side stand-in for <util/atomic.h>. The simulator never preempts
+ * foreground code, so the block only has to keep the I-flag bookkeeping.
+ */
+
+#include <avr/interrupt.h>
+
+static inline uint8_t sim_atomic_enter(void) {
+    uint8_t i = sim_sreg_i;
+    sim_sreg_i = 0;
+    return i;
+}
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) \
+    for (uint8_t sim_i_save = sim_atomic_enter(), sim_once = 1; sim_once; \
+         sim_sreg_i = sim_i_save, sim_once = 0)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+/* Host-side stand-in for <util/delay.h>: busy waits advance simulated time. */
+
+void sim_delay_us(double us);
+
+#define _delay_ms(ms) sim_delay_us((ms) * 1000.0)
+#define _delay_us(us) sim_delay_us(us)
+
+#endif
@@ -0,0 +1,1408 @@
+/*
+ * Host-side simulator for the gate controller firmware.
+ *
+ * The firmware sources are compiled unchanged for the host against the
+ * stand-in avr-libc headers in sim/include, where every I/O register is a
+ * variable defined here. Foreground code runs in zero simulated time; time
+ * only passes while the firmware sleeps or spins in hal_spin(), and then
+ * jumps straight to the next peripheral or scenario event, so an idle hour
+ * costs a few thousand loop passes.
+ *
+ * Modelled peripherals: Timer0 in CTC mode, Timer1 (compare, overflow,
+ * input capture, OC1A on PD5), Timer2 (compare, overflow) counting a 32.768kHz crystal,
+ * the USART at the programmed baud rate, EEPROM with its write time and
+ * EE_RDY interrupt, the ADC, INT0/INT1, the watchdog, and power-down and
+ * power-save sleep, which stop every clock but the crystal's and take
+ * SIM_WAKE_US to start the oscillator again.
+ * Outside the chip there is a push button on PD2, a host on the UART whose
+ * RXD line also reaches INT1 on PD3, a
+ * relay bridge whose contacts release a few milliseconds after their coil
+ * is cut, and a gate that moves while the bridge drives it, stalls against
+ * its endstops and sends hall pulses to ICP1 while it moves, and a 5V rail
+ * behind the supply monitor's divider on ADC1. In a MOTOR_PWM_ENABLE build
+ * leaf A's motor also needs the MOSFET on PD5 to conduct, and the gate
+ * moves for as long as it does. A firmware
+ * built with LEAF_B_ENABLE gets a second bridge on PORTC and a second leaf
+ * with the same travel; the shunt and the hall sensor stay on leaf A.
+ *
+ * Each boot runs in a forked child, so a reset starts .data and .bss from
+ * scratch exactly like the chip does. The clock, EEPROM, gate position and
+ * scenario progress live in shared memory and survive it.
+ *
+ * Usage: gate_controller_sim [-q] [-x] [-t time] [-b time] [-e eeprom.bin] [scenario]
+ *
+ * Scenario lines are "<time> <action> [args]", with "+<time>" relative to
+ * the line before. Times are milliseconds, or take an s, m, h or d suffix.
+ *
+ *   press [ms]           hold the button (default 300ms)
+ *   cmd <c> [addr]       send a frame with command c and no payload
+ *   rx <hex bytes>       send raw bytes to the UART
+ *   block <ms>           obstruct the gate
+ *   travel <ms>          end-to-end travel time of the gate (default 20s)
+ *   current <run> <stall> motor current in ADC counts (default 150 400)
+ *   hall <us>            hall period at full speed, 0 to disconnect
+ *   reset                pulse the reset pin
+ *   power [ms]           cut the supply, for ms before it returns
+ *   supply <mv>          voltage of the 5V rail (default 5000)
+ *   brownout [ms]        brown-out reset, for ms before the rail returns to 5V
+ *   end                  stop the simulation
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+
+#include "button.h"
+#include "command.h"
+#include "hal.h"
+#include "motion.h"
+#include "pwm.h"
+#include "supply.h"
+
+int firmware_main(void);
+
+#define F_MHZ (F_CPU / 1000000UL)
+#define NEVER UINT64_MAX
+#define REG_UNWRITTEN 0x100            // Parked in UDR, TIFR and GIFR, see avr/io.h
+
+#define EXIT_END 0
+#define EXIT_FAIL 1
+#define EXIT_RESET 100
+
+#define EE_WRITE_US 8500               // Datasheet EEPROM programming time
+#define WDT_BASE_US 16384UL            // WDTO_15MS, each step doubles it
+#define T2_CRYSTAL_HZ 32768UL          // Watch crystal on TOSC1/TOSC2
+#define SIM_WAKE_US 2048               // Crystal oscillator start-up, 16K CK at 8MHz
+#define INRUSH_US 300000UL             // Start-up surge before the motor is at speed
+#define INRUSH_RATIO 2                 // Surge current relative to running current
+#define RELAY_RELEASE_US 4000          // Contacts stay closed this long after the coil is cut
+#define DEFAULT_END_MS 60000UL         // Run on this long after the last scenario line
+#define MAX_RX_LEN 32
+
+#define K_OPEN ((1 << RELAY_K1) | (1 << RELAY_K4))
+#define K_CLOSE ((1 << RELAY_K2) | (1 << RELAY_K3))
+#define K_B_OPEN (((1 << RELAY_B_K1) | (1 << RELAY_B_K4)) << 8)    // Leaf B contacts sit in the high byte
+#define K_B_CLOSE (((1 << RELAY_B_K2) | (1 << RELAY_B_K3)) << 8)
+
+enum { DRIVE_OFF, DRIVE_OPEN, DRIVE_CLOSE, DRIVE_SHORT };
+
+enum {
+    ACT_DOWN, ACT_UP, ACT_RX, ACT_BLOCK, ACT_UNBLOCK, ACT_TRAVEL, ACT_CURRENT,
+    ACT_HALL, ACT_RESET, ACT_POWER, ACT_SUPPLY, ACT_BROWNOUT, ACT_END
+};
+
+typedef struct {
+    uint64_t at_us;
+    uint32_t line;
+    uint8_t action;
+    uint32_t arg[2];
+    uint8_t len;
+    uint8_t data[MAX_RX_LEN];
+} sim_event_t;
+
+// Everything that outlives a reset of the chip
+typedef struct {
+    uint64_t now_us;
+    uint64_t end_us;
+    size_t next_event;
+    uint8_t mcucsr;
+    uint8_t eeprom[E2END + 1];
+    uint32_t eeprom_wear[E2END + 1];
+
+    uint32_t travel_us;
+    uint32_t gate_pos_us[MOTION_LEAVES]; // Per leaf, 0 fully closed, travel_us fully open
+    uint32_t hall_period_us;
+    uint16_t current_run;
+    uint16_t current_stall;
+    uint16_t supply_mv;
+    bool blocked;
+    bool button_pressed;
+    uint8_t rx_queue[256];
+    uint8_t rx_head;
+    uint8_t rx_tail;
+
+    uint32_t boots;
+    uint32_t watchdog_resets;
+    uint32_t motor_runs;
+    uint32_t shorts;
+    uint32_t hot_switches;             // Contacts made or broken with the MOSFET conducting
+    uint64_t motor_on_us;
+    uint64_t coil_on_us;               // Summed over all relay coils
+    uint32_t inrush_overlaps;          // A leaf started while the other was still in its inrush
+    uint32_t close_misorders;          // Leaf A reached closed before leaf B
+    uint64_t tx_bytes;
+    uint64_t eeprom_writes;
+    uint64_t boot_max_us;              // Slowest reset to first idle sleep
+    uint64_t asleep_us;                // Time in power-down and power-save
+    uint32_t wakeups;
+    uint32_t rx_lost;                  // Bytes that arrived with the clock stopped
+    uint64_t boot_limit_us;
+} world_t;
+
+static world_t* world;
+static sim_event_t* events;
+static size_t event_count;
+static bool quiet = false;
+static bool hex_output = false;
+
+/* === Registers === */
+
+volatile uint8_t PORTA, DDRA, PINA;
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+
+volatile uint16_t UDR = REG_UNWRITTEN;
+volatile uint8_t UCSRA = (1 << UDRE), UCSRB, UCSRC = (1 << UCSZ1) | (1 << UCSZ0);
+volatile uint8_t UBRRH, UBRRL;
+
+volatile uint8_t GICR, MCUCR, MCUCSR, TIMSK, SFIOR;
+volatile uint16_t GIFR = REG_UNWRITTEN, TIFR = REG_UNWRITTEN;
+
+volatile uint8_t TCCR0, TCNT0, OCR0;
+volatile uint8_t sim_tccr1a, TCCR1B;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2, TCNT2, OCR2, ASSR;
+
+volatile uint8_t ADMUX, ADCSRA, ACSR;
+volatile uint16_t ADC;
+
+volatile uint16_t EEAR;
+volatile uint8_t sim_eedr, sim_eecr;
+volatile uint8_t WDTCR;
+volatile uint16_t SP = RAMEND;
+
+volatile uint8_t sim_sreg_i;
+
+uint8_t sim_stack[SIM_STACK_SIZE];
+
+/* === Chip state, reset with every boot === */
+
+static const uint16_t prescalers[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+static const uint16_t t2_prescalers[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+static uint8_t tifr, gifr;
+static bool pins_valid = false;
+static uint8_t pins_prev;
+
+static uint16_t t0_prescaler = 0;
+static uint64_t t0_period_start;
+static uint64_t t0_next = NEVER;
+
+static uint16_t t1_prescaler = 0;
+static uint64_t t1_base_us;
+static uint64_t t1_base_count;
+static uint16_t t1_shadow;
+static bool oc1a = false;              // Output compare A, on PD5 while COM1A1:0 is set
+
+static uint16_t t2_prescaler = 0;
+static uint64_t t2_base_us;            // When the count was t2_base_count
+static uint8_t t2_base_count;
+static uint8_t t2_shadow;
+static uint64_t t2_next = NEVER;       // Next overflow
+static uint8_t t2_ocr_shadow;
+static uint64_t t2_compare_next = NEVER;
+
+static bool clock_stopped = false;     // Power-down or power-save, or the oscillator starting up
+
+static int16_t tx_hold = -1;
+static uint8_t tx_shift;
+static uint64_t tx_done = NEVER;
+static uint64_t rx_next = NEVER;
+static uint8_t rx_data;
+
+static bool ee_master_armed = false;
+static uint16_t ee_addr;
+static uint8_t ee_data;
+static uint64_t ee_done = NEVER;
+
+static uint64_t adc_next = NEVER;
+static uint64_t hall_next = NEVER;
+static uint64_t wdt_timeout_us;
+static uint64_t wdt_deadline = NEVER;
+
+static uint16_t coils_prev;
+static uint64_t release_at[16] = { [0 ... 15] = NEVER };
+static uint64_t boot_at_us;
+static bool booted = false;
+static uint8_t drive[MOTION_LEAVES];
+static uint64_t drive_since[MOTION_LEAVES];
+
+static char line_buf[256];
+static size_t line_len = 0;
+static uint64_t line_at_us;
+static uint64_t last_tx_us;
+
+/* === Output === */
+
+static void print_stamp(uint64_t us) {
+    printf("[%6llu.%03llu] ", (unsigned long long)(us / 1000000), (unsigned long long)(us / 1000 % 1000));
+}
+
+static void flush_line(void) {
+    if (line_len == 0) return;
+    print_stamp(line_at_us);
+    printf("%.*s\n", (int)line_len, line_buf);
+    line_len = 0;
+}
+
+static void line_append(const char* s) {
+    size_t n = strlen(s);
+    if (line_len + n > sizeof(line_buf)) flush_line();
+    if (line_len == 0) line_at_us = world->now_us;
+    memcpy(line_buf + line_len, s, n);
+    line_len += n;
+}
+
+static void note(const char* fmt, ...) {
+    if (quiet) return;
+
+    va_list ap;
+    flush_line();
+    print_stamp(world->now_us);
+    printf("# ");
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+static void fail(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "sim: ");
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(EXIT_FAIL);
+}
+
+static void uart_output(uint8_t b) {
+    char text[8];
+
+    world->tx_bytes++;
+    if (hex_output) {
+        if (line_len > 0 && world->now_us - last_tx_us > 3000) flush_line();
+        snprintf(text, sizeof(text), "%02X ", b);
+        line_append(text);
+    } else if (b == '\n') {
+        flush_line();
+    } else if (b >= 0x20 && b < 0x7F) {
+        text[0] = (char)b;
+        text[1] = 0;
+        line_append(text);
+    } else if (b != '\r') {
+        snprintf(text, sizeof(text), "\\x%02X", b);
+        line_append(text);
+    }
+    last_tx_us = world->now_us;
+}
+
+/* === Reset === */
+
+static void chip_exit(int code) {
+    flush_line();
+    fflush(stdout);
+    _exit(code);
+}
+
+static void chip_reset(uint8_t cause, const char* why) {
+    note("%s", why);
+    world->mcucsr = cause == (1 << PORF) ? cause : (uint8_t)((MCUCSR & 0x1F) | cause);
+    chip_exit(EXIT_RESET);
+}
+
+static void bad_interrupt(const char* vector) {
+    note("no handler for %s", vector);
+    chip_reset(0, "jumped to the reset vector");
+}
+
+// Vectors the firmware leaves out of this build land in __bad_interrupt, like on the chip
+#define SIM_DEFAULT_VECTOR(name) \
+    __attribute__((weak)) void name(void) { bad_interrupt(#name); }
+
+SIM_DEFAULT_VECTOR(INT0_vect)
+SIM_DEFAULT_VECTOR(INT1_vect)
+SIM_DEFAULT_VECTOR(TIMER0_COMP_vect)
+SIM_DEFAULT_VECTOR(TIMER2_COMP_vect)
+SIM_DEFAULT_VECTOR(TIMER2_OVF_vect)
+SIM_DEFAULT_VECTOR(TIMER1_CAPT_vect)
+SIM_DEFAULT_VECTOR(TIMER1_COMPA_vect)
+SIM_DEFAULT_VECTOR(TIMER1_COMPB_vect)
+SIM_DEFAULT_VECTOR(TIMER1_OVF_vect)
+SIM_DEFAULT_VECTOR(USART_RX_vect)
+SIM_DEFAULT_VECTOR(USART_UDRE_vect)
+SIM_DEFAULT_VECTOR(ADC_vect)
+SIM_DEFAULT_VECTOR(EE_RDY_vect)
+
+/* === Gate and wiring === */
+
+// Leaf A's motor current returns through the MOSFET, in the builds that have one
+static bool mosfet_on(void) {
+#if MOTOR_PWM_ENABLE
+    if (!(DDRD & (1 << PWM_PIN))) return false;
+    if (sim_tccr1a & ((1 << COM1A1) | (1 << COM1A0))) return oc1a;
+    return PORTD & (1 << PWM_PIN);
+#else
+    return true;
+#endif
+}
+
+// A relay coil that is switched off only lets go of its contacts after
+// RELAY_RELEASE_US, which is what lets a PWM held coil stay pulled in
+static uint16_t relay_contacts(void) {
+    uint16_t coils = PORTB & DDRB & RELAY_MASK;
+#if LEAF_B_ENABLE
+    coils |= (uint16_t)(PORTC & DDRC & RELAY_B_MASK) << 8;
+#endif
+    uint16_t closed = coils;
+
+    for (uint8_t i = 0; i < 16; i++) {
+        uint16_t bit = 1 << i;
+        if (coils & bit) {
+            release_at[i] = NEVER;
+        } else if (coils_prev & bit) {
+            release_at[i] = world->now_us + RELAY_RELEASE_US;
+        }
+        if (release_at[i] != NEVER) {
+            if (world->now_us < release_at[i]) closed |= bit; else release_at[i] = NEVER;
+        }
+    }
+    coils_prev = coils;
+    return closed;
+}
+
+static uint64_t relay_release_next(void) {
+    uint64_t t = NEVER;
+    for (uint8_t i = 0; i < 16; i++) {
+        if (release_at[i] < t) t = release_at[i];
+    }
+    return t;
+}
+
+static uint8_t bridge_state(uint8_t leaf, uint16_t on) {
+    uint16_t k_open = leaf == LEAF_A ? K_OPEN : K_B_OPEN;
+    uint16_t k_close = leaf == LEAF_A ? K_CLOSE : K_B_CLOSE;
+
+    if ((on & k_open) && (on & k_close)) return DRIVE_SHORT;
+    if ((on & k_open) == k_open) return DRIVE_OPEN;
+    if ((on & k_close) == k_close) return DRIVE_CLOSE;
+    return DRIVE_OFF;
+}
+
+static bool driving(uint8_t leaf) {
+    return drive[leaf] == DRIVE_OPEN || drive[leaf] == DRIVE_CLOSE;
+}
+
+// An obstruction blocks both leaves
+static bool gate_moving(uint8_t leaf) {
+    if (world->blocked) return false;
+    if (drive[leaf] == DRIVE_OPEN) return world->gate_pos_us[leaf] < world->travel_us;
+    if (drive[leaf] == DRIVE_CLOSE) return world->gate_pos_us[leaf] > 0;
+    return false;
+}
+
+// Moving with the motor powered; a PWM driven leaf coasts to a halt between pulses
+static bool gate_powered(uint8_t leaf) {
+    return gate_moving(leaf) && (leaf != LEAF_A || mosfet_on());
+}
+
+// The shunt is in leaf A's bridge only
+static uint16_t motor_current(void) {
+    if (!driving(LEAF_A) || !mosfet_on()) return 0;
+    if (!gate_moving(LEAF_A)) return world->current_stall;
+    if (world->now_us - drive_since[LEAF_A] < INRUSH_US) return world->current_run * INRUSH_RATIO;
+    return world->current_run;
+}
+
+static uint16_t adc_input(uint8_t channel) {
+    if (channel == SUPPLY_CHANNEL) {
+        uint32_t counts = SUPPLY_COUNTS(world->supply_mv);
+        return counts > 1023 ? 1023 : counts;
+    }
+    return channel == 0 ? motor_current() : 0;
+}
+
+static uint64_t gate_endstop_at(void) {
+    uint64_t t = NEVER;
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        if (!gate_powered(i)) continue;
+        uint32_t left = drive[i] == DRIVE_OPEN ? world->travel_us - world->gate_pos_us[i] : world->gate_pos_us[i];
+        if (world->now_us + left < t) t = world->now_us + left;
+    }
+    return t;
+}
+
+/* === Peripherals === */
+
+static uint32_t uart_byte_us(void) {
+    uint16_t ubrr = ((UBRRH & 0x0F) << 8) | UBRRL;
+    return 10UL * 16 * (ubrr + 1) / F_MHZ;
+}
+
+static uint64_t t1_count(uint64_t at_us) {
+    static uint64_t memo_at = NEVER, memo_count, memo_base;
+
+    if (!t1_prescaler) return t1_base_count;
+    if (at_us != memo_at || t1_base_us != memo_base) {
+        memo_at = at_us;
+        memo_base = t1_base_us;
+        memo_count = (at_us - t1_base_us) * F_MHZ / t1_prescaler;
+    }
+    return t1_base_count + memo_count;
+}
+
+static uint64_t t1_time_of(uint64_t count) {
+    return t1_base_us + ((count - t1_base_count) * t1_prescaler + F_MHZ - 1) / F_MHZ;
+}
+
+// Absolute count of the first match with `value` after `from`
+static uint64_t t1_match(uint64_t from, uint16_t value) {
+    uint32_t ahead = (uint16_t)(value - (uint16_t)from);
+    return from + (ahead ? ahead : 0x10000);
+}
+
+static uint64_t t0_period_us(void) {
+    uint64_t period = (uint64_t)(OCR0 + 1) * t0_prescaler / F_MHZ;
+    return period ? period : 1;
+}
+
+static uint64_t t2_counts_us(uint32_t counts) {
+    return (uint64_t)counts * t2_prescaler * 1000000UL / T2_CRYSTAL_HZ;
+}
+
+static uint64_t t2_elapsed(void) {
+    return (world->now_us - t2_base_us) * T2_CRYSTAL_HZ / (t2_prescaler * 1000000ULL);
+}
+
+static uint8_t t2_count(void) {
+    return (uint8_t)(t2_base_count + t2_elapsed());
+}
+
+// When the count next moves on to OCR2
+static uint64_t t2_compare_at(void) {
+    uint64_t elapsed = t2_elapsed();
+    uint16_t ahead = (uint8_t)(OCR2 - (uint8_t)(t2_base_count + elapsed));
+    return t2_base_us + t2_counts_us(elapsed + (ahead ? ahead : 256));
+}
+
+static uint32_t adc_conversion_us(void) {
+    uint8_t div = 1 << (ADCSRA & 0x07);
+    uint32_t us = 13UL * (div < 2 ? 2 : div) / F_MHZ;
+    return us ? us : 1;
+}
+
+static void set_tifr(uint8_t bits) {
+    tifr |= bits;
+    TIFR = tifr | REG_UNWRITTEN;
+}
+
+static void set_gifr(uint8_t bits) {
+    gifr |= bits;
+    GIFR = gifr | REG_UNWRITTEN;
+}
+
+// What a compare match or FOC1A does to OC1A under the current COM1A1:0
+static void oc1a_compare(void) {
+    switch ((sim_tccr1a >> COM1A0) & 0x03) {
+        case 1: oc1a = !oc1a; break;
+        case 2: oc1a = false; break;
+        case 3: oc1a = true; break;
+    }
+}
+
+static void oc1a_sync(void) {
+    if (sim_tccr1a & (1 << FOC1A)) {
+        sim_tccr1a &= ~(1 << FOC1A);           // Strobe, always reads as zero
+        oc1a_compare();
+    }
+}
+
+volatile uint8_t* sim_timer1_reg(volatile uint8_t* reg) {
+    oc1a_sync();
+    return reg;
+}
+
+static void ee_sync(void) {
+    if (sim_eecr & (1 << EERE)) {
+        sim_eecr &= ~(1 << EERE);
+        if (!(sim_eecr & (1 << EEWE))) sim_eedr = world->eeprom[EEAR & E2END];
+    }
+
+    // EEWE only starts a write within four cycles of EEMWE, i.e. the next access
+    if ((sim_eecr & (1 << EEWE)) && ee_done == NEVER) {
+        if (ee_master_armed) {
+            ee_addr = EEAR & E2END;
+            ee_data = sim_eedr;
+            ee_done = world->now_us + EE_WRITE_US;
+        } else {
+            sim_eecr &= ~(1 << EEWE);
+        }
+    }
+    ee_master_armed = sim_eecr & (1 << EEMWE);
+    sim_eecr &= ~(1 << EEMWE);
+}
+
+static uint16_t dispatch(void);
+
+// Code takes no time here, so an EE_RDY_vect the chip would have taken by
+// this access, starting the next write, runs now; dispatch() syncs the strobes
+volatile uint8_t* sim_eeprom_reg(volatile uint8_t* reg) {
+    dispatch();
+    return reg;
+}
+
+static void uart_write(uint8_t b) {
+    UCSRA &= ~(1 << TXC);
+    if (tx_done == NEVER) {
+        tx_shift = b;
+        tx_done = world->now_us + uart_byte_us();
+    } else if (tx_hold < 0) {
+        tx_hold = b;
+    } else {
+        note("UDR written while full, byte 0x%02X lost", b);
+    }
+}
+
+static void sync_pins(void) {
+    uint8_t driven = (1 << PD0);               // RX idles high
+    uint8_t level = (1 << PD0);
+
+    if (world->button_pressed) driven |= (1 << BUTTON_PIN);
+
+    PINA = PORTA;
+    PINB = PORTB;
+    PINC = PORTC;
+    // RXD is also wired to INT1, and reads low for as long as a byte is on the line
+    if (rx_next != NEVER) driven |= (1 << PD3);
+
+    uint8_t port_d = PORTD;
+    if (sim_tccr1a & ((1 << COM1A1) | (1 << COM1A0))) {
+        port_d = oc1a ? port_d | (1 << PD5) : port_d & ~(1 << PD5);
+    }
+    PIND = (port_d & DDRD) | (driven & level & ~DDRD) | (~driven & ~DDRD & PORTD);
+
+    uint8_t pins = PIND;
+    if (pins_valid) {
+        uint8_t changed = pins ^ pins_prev;
+        uint8_t isc[2] = { MCUCR & 0x03, (MCUCR >> 2) & 0x03 };
+        uint8_t pin[2] = { PD2, PD3 };
+        uint8_t flag[2] = { 1 << INTF0, 1 << INTF1 };
+
+        for (uint8_t i = 0; i < 2; i++) {
+            if (!(changed & (1 << pin[i]))) continue;
+            bool high = pins & (1 << pin[i]);
+            if (isc[i] == 1 || (isc[i] == 2 && !high) || (isc[i] == 3 && high)) set_gifr(flag[i]);
+        }
+    }
+    pins_prev = pins;
+    pins_valid = true;
+}
+
+static void sync_bridge(void) {
+    static const char* const names[] = { "off", "open", "close", "both directions on" };
+    static const char* const leaf_names[] = { "", "leaf B " };
+    uint16_t contacts = relay_contacts();
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        uint8_t state = bridge_state(i, contacts);
+        if (state == drive[i]) continue;
+
+        note("%srelays %s", leaf_names[i], names[state]);
+        if (state == DRIVE_SHORT) world->shorts++;
+        if (MOTOR_PWM_ENABLE && i == LEAF_A && mosfet_on()) {
+            note("relay contacts switched with the MOSFET on");
+            world->hot_switches++;
+        }
+        drive[i] = state;
+        drive_since[i] = world->now_us;
+        if (!driving(i)) continue;
+
+        world->motor_runs++;
+        for (uint8_t j = 0; j < MOTION_LEAVES; j++) {
+            if (j != i && driving(j) && world->now_us - drive_since[j] < INRUSH_US) {
+                note("inrush overlaps the other leaf");
+                world->inrush_overlaps++;
+            }
+        }
+    }
+
+    if (gate_moving(LEAF_A) && world->hall_period_us) {
+        if (hall_next == NEVER) hall_next = world->now_us + world->hall_period_us;
+    } else {
+        hall_next = NEVER;
+    }
+}
+
+// Picks up whatever the firmware wrote since the last call
+static void sync_chip(void) {
+    if (!(TIFR & REG_UNWRITTEN)) tifr &= ~TIFR;   // Writing a one clears the flag
+    TIFR = tifr | REG_UNWRITTEN;
+    if (!(GIFR & REG_UNWRITTEN)) gifr &= ~GIFR;
+    GIFR = gifr | REG_UNWRITTEN;
+
+    if (!(UDR & REG_UNWRITTEN)) {
+        uint8_t b = UDR;
+        UDR = REG_UNWRITTEN;
+        if (UCSRB & (1 << TXEN)) uart_write(b);
+    }
+    if (tx_hold < 0) UCSRA |= (1 << UDRE); else UCSRA &= ~(1 << UDRE);
+
+    ee_sync();
+    oc1a_sync();
+
+    // Timer0: only the CTC mode timer.c uses
+    uint16_t p0 = prescalers[TCCR0 & 0x07];
+    if (p0 != t0_prescaler) {
+        t0_prescaler = p0;
+        t0_period_start = world->now_us;
+        t0_next = p0 ? world->now_us + t0_period_us() : NEVER;
+    }
+    if (p0) TCNT0 = (uint8_t)((world->now_us - t0_period_start) * F_MHZ / p0);
+
+    uint16_t p1 = prescalers[TCCR1B & 0x07];
+    if (TCNT1 != t1_shadow) {
+        t1_base_count = TCNT1;
+        t1_base_us = world->now_us;
+    } else if (p1 != t1_prescaler) {
+        t1_base_count = t1_count(world->now_us);
+        t1_base_us = world->now_us;
+    }
+    t1_prescaler = p1;
+    t1_shadow = TCNT1 = (uint16_t)t1_count(world->now_us);
+
+    // Timer2: only clocked asynchronously from the crystal, as auto_close.c runs it
+    uint16_t p2 = (ASSR & (1 << AS2)) ? t2_prescalers[TCCR2 & 0x07] : 0;
+    if (TCNT2 != t2_shadow || p2 != t2_prescaler) {
+        t2_base_count = TCNT2 != t2_shadow || !t2_prescaler ? TCNT2 : t2_count();
+        t2_base_us = world->now_us;
+        t2_prescaler = p2;
+        t2_next = p2 ? world->now_us + t2_counts_us(256 - t2_base_count) : NEVER;
+    }
+    if (p2) TCNT2 = t2_count();
+    t2_shadow = TCNT2;
+    if (!p2) {
+        t2_compare_next = NEVER;
+    } else if (t2_compare_next == NEVER || OCR2 != t2_ocr_shadow || t2_base_us == world->now_us) {
+        t2_compare_next = t2_compare_at();
+    }
+    t2_ocr_shadow = OCR2;
+
+    bool adc_on = (ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADSC));
+    if (!adc_on) {
+        adc_next = NEVER;
+    } else if (adc_next == NEVER) {
+        adc_next = world->now_us + adc_conversion_us();
+    }
+
+    sync_bridge();
+    sync_pins();
+}
+
+/* === Scenario === */
+
+static void apply(const sim_event_t* ev) {
+    switch (ev->action) {
+        case ACT_DOWN:
+            note("button down");
+            world->button_pressed = true;
+            break;
+        case ACT_UP:
+            note("button up");
+            world->button_pressed = false;
+            break;
+        case ACT_RX:
+            for (uint8_t i = 0; i < ev->len; i++) {
+                if ((uint8_t)(world->rx_head + 1) == world->rx_tail) fail("line %u: UART input backlog full", ev->line);
+                world->rx_queue[world->rx_head++] = ev->data[i];
+            }
+            break;
+        case ACT_BLOCK:
+            note("gate obstructed");
+            world->blocked = true;
+            break;
+        case ACT_UNBLOCK:
+            note("obstruction cleared");
+            world->blocked = false;
+            break;
+        case ACT_TRAVEL:
+            world->travel_us = ev->arg[0];
+            for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+                if (world->gate_pos_us[i] > world->travel_us) world->gate_pos_us[i] = world->travel_us;
+            }
+            break;
+        case ACT_CURRENT:
+            world->current_run = ev->arg[0];
+            world->current_stall = ev->arg[1];
+            break;
+        case ACT_HALL:
+            world->hall_period_us = ev->arg[0];
+            break;
+        case ACT_RESET:
+            chip_reset(1 << EXTRF, "reset pin pulled low");
+            break;
+        case ACT_POWER:
+            note("power off for %u ms", ev->arg[0] / 1000);
+            world->now_us += ev->arg[0];
+            chip_reset(1 << PORF, "power restored");
+            break;
+        case ACT_SUPPLY:
+            note("supply at %u mV", ev->arg[0]);
+            world->supply_mv = ev->arg[0];
+            break;
+        case ACT_BROWNOUT:
+            note("brown-out for %u ms", ev->arg[0] / 1000);
+            world->now_us += ev->arg[0];
+            world->supply_mv = 5000;
+            chip_reset(1 << BORF, "supply restored");
+            break;
+        case ACT_END:
+            world->end_us = world->now_us;
+            break;
+    }
+}
+
+/* === Time === */
+
+static uint64_t next_event_at(void) {
+    uint64_t t = world->end_us;
+    uint64_t c = t1_count(world->now_us);
+
+#define SOONER(x) do { uint64_t v = (x); if (v < t) t = v; } while (0)
+    if (!clock_stopped) SOONER(t0_next);
+    if (t1_prescaler && !clock_stopped) {
+        if (TIMSK & (1 << OCIE1A)) SOONER(t1_time_of(t1_match(c, OCR1A)));
+        if (TIMSK & (1 << OCIE1B)) SOONER(t1_time_of(t1_match(c, OCR1B)));
+        if (TIMSK & (1 << TOIE1)) SOONER(t1_time_of(t1_match(c, 0)));
+    }
+    if (TIMSK & (1 << TOIE2)) SOONER(t2_next);
+    if (TIMSK & (1 << OCIE2)) SOONER(t2_compare_next);
+    SOONER(tx_done);
+    SOONER(rx_next);
+    SOONER(ee_done);
+    SOONER(adc_next);
+    SOONER(hall_next);
+    SOONER(relay_release_next());
+    SOONER(gate_endstop_at());
+    SOONER(wdt_deadline);
+    if (world->next_event < event_count) SOONER(events[world->next_event].at_us);
+    if (world->rx_head != world->rx_tail && rx_next == NEVER) SOONER(world->now_us);
+#undef SOONER
+
+    return t < world->now_us ? world->now_us : t;
+}
+
+static void advance(uint64_t to) {
+    uint64_t from = world->now_us;
+    uint64_t dt = to - from;
+    bool was_moving[MOTION_LEAVES];
+
+    // Hall pulses come per distance, so the ones of a PWM driven leaf wait out the off time
+    if (hall_next != NEVER && !gate_powered(LEAF_A)) hall_next += dt;
+
+    world->coil_on_us += dt * __builtin_popcount(coils_prev);
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        uint32_t* pos = &world->gate_pos_us[i];
+        was_moving[i] = gate_moving(i);
+        if (driving(i) && (i != LEAF_A || mosfet_on())) world->motor_on_us += dt;
+        if (!gate_powered(i)) continue;
+        if (drive[i] == DRIVE_OPEN) {
+            *pos = dt >= world->travel_us - *pos ? world->travel_us : *pos + dt;
+        } else {
+            *pos = dt >= *pos ? 0 : *pos - dt;
+        }
+    }
+
+    // Stopped clocks pick up where they were once the oscillator runs again
+    if (clock_stopped) {
+        world->asleep_us += dt;
+        t0_period_start += dt;
+        if (t0_next != NEVER) t0_next += dt;
+        t1_base_us += dt;
+        if (tx_done != NEVER) tx_done += dt;
+        if (adc_next != NEVER) adc_next += dt;
+    } else if (t1_prescaler) {
+        uint64_t c0 = t1_count(from);
+        uint64_t c1 = t1_count(to);
+        if (t1_match(c0, OCR1A) <= c1) {
+            set_tifr(1 << OCF1A);
+            oc1a_compare();
+        }
+        if (t1_match(c0, OCR1B) <= c1) set_tifr(1 << OCF1B);
+        if (t1_match(c0, 0) <= c1) set_tifr(1 << TOV1);
+    }
+
+    world->now_us = to;
+
+    if (to >= world->end_us) chip_exit(EXIT_END);
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        if (!was_moving[i] || gate_moving(i)) continue;
+        if (i == LEAF_A) {
+            note(drive[i] == DRIVE_OPEN ? "gate at open endstop" : "gate at closed endstop");
+        } else {
+            note(drive[i] == DRIVE_OPEN ? "leaf B at open endstop" : "leaf B at closed endstop");
+        }
+#if LEAF_B_ENABLE
+        // Leaf A carries the overlap strip and has to shut last
+        if (i == LEAF_A && drive[i] == DRIVE_CLOSE && world->gate_pos_us[LEAF_A] == 0 && world->gate_pos_us[LEAF_B] > 0) {
+            note("leaf A closed ahead of leaf B");
+            world->close_misorders++;
+        }
+#endif
+    }
+
+    if (t2_next <= to) {
+        uint64_t period = t2_counts_us(256);
+        t2_next += (to - t2_next) / period * period + period;
+        t2_base_us = t2_next - period;
+        t2_base_count = 0;
+        set_tifr(1 << TOV2);
+    }
+    if (t2_compare_next <= to) {
+        uint64_t period = t2_counts_us(256);
+        t2_compare_next += (to - t2_compare_next) / period * period + period;
+        set_tifr(1 << OCF2);
+    }
+
+    if (t0_next <= to) {
+        t0_period_start = t0_next;
+        t0_next += t0_period_us();
+        set_tifr(1 << OCF0);
+    }
+
+    if (tx_done <= to) {
+        uart_output(tx_shift);
+        if (tx_hold >= 0) {
+            tx_shift = (uint8_t)tx_hold;
+            tx_hold = -1;
+            tx_done += uart_byte_us();
+        } else {
+            tx_done = NEVER;
+            UCSRA |= (1 << TXC);
+        }
+    }
+
+    if (world->rx_head != world->rx_tail && rx_next == NEVER) {
+        rx_next = to + uart_byte_us();
+    } else if (rx_next <= to) {
+        uint8_t b = world->rx_queue[world->rx_tail++];
+        if (clock_stopped) {
+            world->rx_lost++;
+            note("byte 0x%02X lost, received with the clock stopped", b);
+        } else if (UCSRB & (1 << RXEN)) {
+            if (UCSRA & (1 << RXC)) {
+                UCSRA |= (1 << DOR);
+            } else {
+                rx_data = b;
+                UCSRA |= (1 << RXC);
+            }
+        }
+        rx_next = world->rx_head != world->rx_tail ? rx_next + uart_byte_us() : NEVER;
+    }
+
+    if (ee_done <= to) {
+        world->eeprom[ee_addr] = ee_data;
+        world->eeprom_wear[ee_addr]++;
+        world->eeprom_writes++;
+        sim_eecr &= ~(1 << EEWE);
+        ee_done = NEVER;
+    }
+
+    if (adc_next <= to) {
+        ADC = adc_input(ADMUX & 0x07);
+        ADCSRA |= (1 << ADIF);
+        if (ADCSRA & (1 << ADATE)) {
+            adc_next += adc_conversion_us();
+        } else {
+            ADCSRA &= ~(1 << ADSC);
+            adc_next = NEVER;
+        }
+    }
+
+    if (hall_next <= to) {
+        ICR1 = (uint16_t)t1_count(to);
+        set_tifr(1 << ICF1);
+        hall_next += world->hall_period_us;
+    }
+
+    if (wdt_deadline <= to) {
+        world->watchdog_resets++;
+        chip_reset(1 << WDRF, "watchdog timeout");
+    }
+
+    while (world->next_event < event_count && events[world->next_event].at_us <= to) {
+        apply(&events[world->next_event++]);
+    }
+}
+
+// Callers have just run dispatch(), so the registers are in sync
+static void step(void) {
+    advance(next_event_at());
+}
+
+/* === Interrupts === */
+
+enum {
+    IRQ_INT0, IRQ_INT1, IRQ_TIMER2_COMP, IRQ_TIMER2_OVF, IRQ_TIMER1_CAPT, IRQ_TIMER1_COMPA, IRQ_TIMER1_COMPB, IRQ_TIMER1_OVF,
+    IRQ_USART_RX, IRQ_USART_UDRE, IRQ_ADC, IRQ_EE_RDY, IRQ_TIMER0_COMP, IRQ_COUNT
+};
+
+static bool ext_pending(uint8_t enable, uint8_t isc, uint8_t pin, uint8_t flag) {
+    if (!(GICR & enable)) return false;
+    if (isc == 0) return !(PIND & (1 << pin));  // Level triggered, no flag
+    return gifr & flag;
+}
+
+// Returns the highest priority pending interrupt, cleared as on vector entry
+static int8_t take_irq(void) {
+    if (ext_pending(1 << INT0, MCUCR & 0x03, PD2, 1 << INTF0)) {
+        gifr &= ~(1 << INTF0);
+        return IRQ_INT0;
+    }
+    if (ext_pending(1 << INT1, (MCUCR >> 2) & 0x03, PD3, 1 << INTF1)) {
+        gifr &= ~(1 << INTF1);
+        return IRQ_INT1;
+    }
+
+    static const struct { uint8_t irq, enable, flag; } timer_irqs[] = {
+        { IRQ_TIMER2_COMP, 1 << OCIE2, 1 << OCF2 },
+        { IRQ_TIMER2_OVF, 1 << TOIE2, 1 << TOV2 },
+        { IRQ_TIMER1_CAPT, 1 << TICIE1, 1 << ICF1 },
+        { IRQ_TIMER1_COMPA, 1 << OCIE1A, 1 << OCF1A },
+        { IRQ_TIMER1_COMPB, 1 << OCIE1B, 1 << OCF1B },
+        { IRQ_TIMER1_OVF, 1 << TOIE1, 1 << TOV1 },
+    };
+    for (uint8_t i = 0; i < sizeof(timer_irqs) / sizeof(timer_irqs[0]); i++) {
+        if ((TIMSK & timer_irqs[i].enable) && (tifr & timer_irqs[i].flag)) {
+            tifr &= ~timer_irqs[i].flag;
+            return timer_irqs[i].irq;
+        }
+    }
+
+    if ((UCSRB & (1 << RXCIE)) && (UCSRA & (1 << RXC))) return IRQ_USART_RX;
+    if ((UCSRB & (1 << UDRIE)) && (UCSRA & (1 << UDRE))) return IRQ_USART_UDRE;
+    if ((ADCSRA & (1 << ADIE)) && (ADCSRA & (1 << ADIF))) {
+        ADCSRA &= ~(1 << ADIF);
+        return IRQ_ADC;
+    }
+    if ((sim_eecr & (1 << EERIE)) && !(sim_eecr & (1 << EEWE))) return IRQ_EE_RDY;
+    if ((TIMSK & (1 << OCIE0)) && (tifr & (1 << OCF0))) {
+        tifr &= ~(1 << OCF0);
+        return IRQ_TIMER0_COMP;
+    }
+    return -1;
+}
+
+static void (*const vectors[IRQ_COUNT])(void) = {
+    INT0_vect, INT1_vect, TIMER2_COMP_vect, TIMER2_OVF_vect, TIMER1_CAPT_vect, TIMER1_COMPA_vect, TIMER1_COMPB_vect, TIMER1_OVF_vect,
+    USART_RX_vect, USART_UDRE_vect, ADC_vect, EE_RDY_vect, TIMER0_COMP_vect,
+};
+
+// Runs every pending interrupt, returns how many ran
+static uint16_t dispatch(void) {
+    uint16_t taken = 0;
+
+    sync_chip();
+    while (sim_sreg_i) {
+        int8_t irq = take_irq();
+        if (irq < 0) break;
+        if (++taken > 10000) fail("interrupt storm at %llu us", (unsigned long long)world->now_us);
+
+        TIFR = tifr | REG_UNWRITTEN;
+        GIFR = gifr | REG_UNWRITTEN;
+        if (irq == IRQ_USART_RX) UDR = rx_data;
+
+        sim_sreg_i = 0;
+        vectors[irq]();
+        sim_sreg_i = 1;
+
+        if (irq == IRQ_USART_RX) {
+            UCSRA &= ~(1 << RXC);
+            UDR = REG_UNWRITTEN;
+        }
+        sync_chip();
+    }
+    return taken;
+}
+
+// Only a low level on INT0/INT1 and, in power-save, Timer2 still get through
+static bool wake_pending(void) {
+    bool ext = (GICR & (1 << INT0) && !(MCUCR & 0x03) && !(PIND & (1 << PD2))) ||
+        (GICR & (1 << INT1) && !(MCUCR & 0x0C) && !(PIND & (1 << PD3)));
+    bool t2 = (MCUCR & (1 << SM0)) && (ASSR & (1 << AS2)) &&
+        (((TIMSK & (1 << OCIE2)) && (tifr & (1 << OCF2))) || ((TIMSK & (1 << TOIE2)) && (tifr & (1 << TOV2))));
+    return sim_sreg_i && (ext || t2);
+}
+
+static void deep_sleep(void) {
+    clock_stopped = true;
+    sync_chip();
+    while (!wake_pending()) {
+        step();
+        sync_chip();
+    }
+
+    // A level that goes away during the start-up still wakes the chip, without its interrupt
+    uint64_t running = world->now_us + SIM_WAKE_US;
+    while (world->now_us < running) {
+        uint64_t t = next_event_at();
+        advance(t < running ? t : running);
+    }
+    clock_stopped = false;
+    world->wakeups++;
+    dispatch();
+}
+
+/* === Hooks called by the firmware === */
+
+void sim_sleep_cpu(void) {
+    // The first sleep is the main loop running with nothing left to do from boot
+    if (!booted) {
+        uint64_t boot_us = world->now_us - boot_at_us;
+        booted = true;
+        if (boot_us > world->boot_max_us) world->boot_max_us = boot_us;
+        if (world->boot_limit_us && boot_us > world->boot_limit_us) {
+            fail("boot took %llu us, limit %llu us", (unsigned long long)boot_us, (unsigned long long)world->boot_limit_us);
+        }
+    }
+    if (MCUCR & (1 << SM1)) {
+        deep_sleep();
+        return;
+    }
+    while (!dispatch()) step();
+}
+
+void sim_spin(void) {
+    if (dispatch()) return;
+    step();
+    dispatch();
+}
+
+void sim_delay_us(double us) {
+    uint64_t until = world->now_us + (uint64_t)us;
+
+    while (world->now_us < until) {
+        dispatch();
+        uint64_t t = next_event_at();
+        advance(t < until ? t : until);
+    }
+    dispatch();
+}
+
+void sim_wdt_enable(uint8_t timeout) {
+    wdt_timeout_us = WDT_BASE_US << timeout;
+    wdt_deadline = world->now_us + wdt_timeout_us;
+}
+
+void sim_wdt_disable(void) {
+    wdt_deadline = NEVER;
+}
+
+void sim_wdt_reset(void) {
+    if (wdt_deadline != NEVER) wdt_deadline = world->now_us + wdt_timeout_us;
+}
+
+// As avr-libc does it: an EE_RDY_vect that starts a write between the poll
+// and EERE leaves its own byte in EEDR, which is what the read returns
+uint8_t eeprom_read_byte(const uint8_t* addr) {
+    while (sim_eecr & (1 << EEWE)) sim_spin();
+    dispatch();
+    EEAR = (uintptr_t)addr & E2END;
+    EECR |= (1 << EERE);
+    return EEDR;
+}
+
+void eeprom_write_byte(uint8_t* addr, uint8_t value) {
+    while (sim_eecr & (1 << EEWE)) sim_spin();
+    ee_addr = (uintptr_t)addr & E2END;
+    ee_data = value;
+    ee_done = world->now_us + EE_WRITE_US;
+    sim_eecr |= (1 << EEWE);
+}
+
+void eeprom_update_byte(uint8_t* addr, uint8_t value) {
+    if (eeprom_read_byte(addr) != value) eeprom_write_byte(addr, value);
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+    }
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        eeprom_update_byte((uint8_t*)dst + i, ((const uint8_t*)src)[i]);
+    }
+}
+
+/* === Scenario parsing === */
+
+static bool parse_time(const char* s, uint64_t prev_us, uint64_t* out_us) {
+    bool relative = *s == '+';
+    char* end;
+    double value = strtod(relative ? s + 1 : s, &end);
+    double scale;
+
+    if (end == s || value < 0) return false;
+    if (!*end || !strcmp(end, "ms")) scale = 1e3;
+    else if (!strcmp(end, "us")) scale = 1;
+    else if (!strcmp(end, "s")) scale = 1e6;
+    else if (!strcmp(end, "m")) scale = 60e6;
+    else if (!strcmp(end, "h")) scale = 3600e6;
+    else if (!strcmp(end, "d")) scale = 86400e6;
+    else return false;
+
+    *out_us = (relative ? prev_us : 0) + (uint64_t)(value * scale);
+    return true;
+}
+
+static sim_event_t* add_event(uint64_t at_us, uint32_t line, uint8_t action) {
+    static size_t capacity = 0;
+
+    if (event_count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        events = realloc(events, capacity * sizeof(*events));
+        if (!events) fail("out of memory");
+    }
+    sim_event_t* ev = &events[event_count++];
+    memset(ev, 0, sizeof(*ev));
+    ev->at_us = at_us;
+    ev->line = line;
+    ev->action = action;
+    return ev;
+}
+
+// Durations use the same units as scenario times and come back in microseconds
+static uint32_t arg_us(const char* s, uint32_t fallback, uint32_t line) {
+    uint64_t us;
+    if (!s) return fallback;
+    if (!parse_time(s, 0, &us) || us > UINT32_MAX) fail("line %u: bad duration '%s'", line, s);
+    return (uint32_t)us;
+}
+
+static uint32_t arg_num(const char* s, uint32_t line) {
+    char* end;
+    if (!s) fail("line %u: missing argument", line);
+    unsigned long v = strtoul(s, &end, 0);
+    if (*end) fail("line %u: bad number '%s'", line, s);
+    return (uint32_t)v;
+}
+
+static int event_order(const void* a, const void* b) {
+    const sim_event_t* x = a;
+    const sim_event_t* y = b;
+    if (x->at_us != y->at_us) return x->at_us < y->at_us ? -1 : 1;
+    if (x->line != y->line) return x->line < y->line ? -1 : 1;
+    return x->action < y->action ? -1 : x->action > y->action;
+}
+
+static void load_scenario(FILE* f, uint64_t* last_us, bool* has_end) {
+    char buf[512];
+    uint32_t line = 0;
+    uint64_t prev_us = 0;
+
+    while (fgets(buf, sizeof(buf), f)) {
+        line++;
+        char* hash = strchr(buf, '#');
+        if (hash) *hash = 0;
+
+        char* tok[MAX_RX_LEN + 2];
+        int n = 0;
+        for (char* t = strtok(buf, " \t\r\n"); t && n < MAX_RX_LEN + 2; t = strtok(NULL, " \t\r\n")) tok[n++] = t;
+        if (n == 0) continue;
+        if (n < 2) fail("line %u: expected '<time> <action>'", line);
+        for (int i = n; i < MAX_RX_LEN + 2; i++) tok[i] = NULL;
+
+        uint64_t at;
+        if (!parse_time(tok[0], prev_us, &at)) fail("line %u: bad time '%s'", line, tok[0]);
+        prev_us = at;
+
+        const char* act = tok[1];
+        if (!strcmp(act, "press")) {
+            add_event(at, line, ACT_DOWN);
+            add_event(at + arg_us(tok[2], 300000, line), line, ACT_UP);
+        } else if (!strcmp(act, "block")) {
+            add_event(at, line, ACT_BLOCK);
+            add_event(at + arg_us(tok[2], 1000000, line), line, ACT_UNBLOCK);
+        } else if (!strcmp(act, "rx")) {
+            sim_event_t* ev = add_event(at, line, ACT_RX);
+            for (int i = 2; i < n; i++) {
+                if (ev->len == MAX_RX_LEN) fail("line %u: at most %d bytes per line", line, MAX_RX_LEN);
+                uint32_t b = strtoul(tok[i], NULL, 16);
+                ev->data[ev->len++] = (uint8_t)b;
+            }
+        } else if (!strcmp(act, "cmd")) {
+            if (!tok[2] || strlen(tok[2]) != 1) fail("line %u: cmd takes one command character", line);
+            sim_event_t* ev = add_event(at, line, ACT_RX);
+            uint8_t frame[4] = { tok[3] ? (uint8_t)arg_num(tok[3], line) : COMMAND_NODE_ADDR, (uint8_t)tok[2][0], 0 };
+            uint8_t crc = 0;
+            ev->data[ev->len++] = COMMAND_STX;
+            for (uint8_t i = 0; i < 3; i++) {
+                crc = _crc8_ccitt_update(crc, frame[i]);
+                ev->data[ev->len++] = frame[i];
+            }
+            ev->data[ev->len++] = crc;
+        } else if (!strcmp(act, "travel")) {
+            add_event(at, line, ACT_TRAVEL)->arg[0] = arg_us(tok[2], 0, line);
+        } else if (!strcmp(act, "current")) {
+            sim_event_t* ev = add_event(at, line, ACT_CURRENT);
+            ev->arg[0] = arg_num(tok[2], line);
+            ev->arg[1] = arg_num(tok[3], line);
+        } else if (!strcmp(act, "hall")) {
+            add_event(at, line, ACT_HALL)->arg[0] = arg_num(tok[2], line);
+        } else if (!strcmp(act, "reset")) {
+            add_event(at, line, ACT_RESET);
+        } else if (!strcmp(act, "power")) {
+            add_event(at, line, ACT_POWER)->arg[0] = arg_us(tok[2], 1000000, line);
+        } else if (!strcmp(act, "supply")) {
+            add_event(at, line, ACT_SUPPLY)->arg[0] = arg_num(tok[2], line);
+        } else if (!strcmp(act, "brownout")) {
+            add_event(at, line, ACT_BROWNOUT)->arg[0] = arg_us(tok[2], 1000000, line);
+        } else if (!strcmp(act, "end")) {
+            add_event(at, line, ACT_END);
+            *has_end = true;
+        } else {
+            fail("line %u: unknown action '%s'", line, act);
+        }
+        if (events[event_count - 1].at_us > *last_us) *last_us = events[event_count - 1].at_us;
+    }
+
+    qsort(events, event_count, sizeof(*events), event_order);
+}
+
+/* === Main === */
+
+static void usage(void) {
+    fprintf(stderr, "usage: gate_controller_sim [-q] [-x] [-t time] [-b time] [-e eeprom.bin] [scenario]\n"
+                    "  -q  only print UART output\n"
+                    "  -x  print UART output as hex\n"
+                    "  -t  stop after this much simulated time\n"
+                    "  -b  fail if any boot takes longer than this to reach the main loop\n"
+                    "  -e  load EEPROM from this file and save it back at the end\n");
+    exit(EXIT_FAIL);
+}
+
+int main(int argc, char** argv) {
+    const char* eeprom_path = NULL;
+    uint64_t limit_us = 0;
+    uint64_t boot_limit_us = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "qxt:b:e:")) != -1) {
+        switch (opt) {
+            case 'q': quiet = true; break;
+            case 'x': hex_output = true; break;
+            case 't': if (!parse_time(optarg, 0, &limit_us)) usage(); break;
+            case 'b': if (!parse_time(optarg, 0, &boot_limit_us)) usage(); break;
+            case 'e': eeprom_path = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind < argc - 1) usage();
+
+    world = mmap(NULL, sizeof(*world), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (world == MAP_FAILED) fail("mmap: %s", strerror(errno));
+    memset(world, 0, sizeof(*world));
+    memset(world->eeprom, 0xFF, sizeof(world->eeprom));
+    world->travel_us = 20000000UL;
+    world->hall_period_us = 10000;
+    world->current_run = 150;
+    world->current_stall = 400;
+    world->supply_mv = 5000;
+    world->mcucsr = 1 << PORF;
+    world->boot_limit_us = boot_limit_us;
+
+    if (eeprom_path) {
+        FILE* f = fopen(eeprom_path, "rb");
+        if (f) {
+            if (fread(world->eeprom, 1, sizeof(world->eeprom), f) == 0 && ferror(f)) fail("%s: read error", eeprom_path);
+            fclose(f);
+        }
+    }
+
+    uint64_t last_us = 0;
+    bool has_end = false;
+    if (optind < argc) {
+        FILE* f = strcmp(argv[optind], "-") ? fopen(argv[optind], "r") : stdin;
+        if (!f) fail("%s: %s", argv[optind], strerror(errno));
+        load_scenario(f, &last_us, &has_end);
+        if (f != stdin) fclose(f);
+    }
+    world->end_us = limit_us ? limit_us : has_end ? NEVER : last_us + DEFAULT_END_MS * 1000;
+
+    struct timespec t0, t1;
+    int status = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+    for (;;) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) fail("fork: %s", strerror(errno));
+        if (pid == 0) {
+            world->boots++;
+            boot_at_us = world->now_us;
+            MCUCSR = world->mcucsr;
+            firmware_main();
+            note("firmware main() returned");
+            chip_exit(EXIT_FAIL);
+        }
+        if (waitpid(pid, &status, 0) < 0) fail("waitpid: %s", strerror(errno));
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_RESET) break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (WIFSIGNALED(status)) fprintf(stderr, "sim: firmware crashed with signal %d\n", WTERMSIG(status));
+
+    double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double simulated = world->now_us / 1e6;
+    uint16_t worn = 0;
+    for (uint16_t i = 1; i <= E2END; i++) {
+        if (world->eeprom_wear[i] > world->eeprom_wear[worn]) worn = i;
+    }
+
+    fprintf(stderr, "sim: %.3f s simulated in %.3f s (%.0fx real time)\n", simulated, wall, wall > 0 ? simulated / wall : 0);
+    fprintf(stderr, "sim: %u boots, %u watchdog resets, %u motor runs, %.1f s motor on, %.1f s coils on, %u shorts\n",
+            world->boots, world->watchdog_resets, world->motor_runs, world->motor_on_us / 1e6,
+            world->coil_on_us / 1e6, world->shorts);
+#if LEAF_B_ENABLE
+    fprintf(stderr, "sim: %u overlapping leaf inrushes, %u closes with leaf A ahead of leaf B\n",
+            world->inrush_overlaps, world->close_misorders);
+#endif
+#if MOTOR_PWM_ENABLE
+    fprintf(stderr, "sim: %u relay switches with the MOSFET on\n", world->hot_switches);
+#endif
+    fprintf(stderr, "sim: slowest boot reached the main loop in %.3f ms of UART and EEPROM waits\n", world->boot_max_us / 1e3);
+    if (world->wakeups) {
+        fprintf(stderr, "sim: %.1f s asleep in power-save, %u wake-ups, %u UART bytes lost asleep\n",
+                world->asleep_us / 1e6, world->wakeups, world->rx_lost);
+    }
+    fprintf(stderr, "sim: %llu UART bytes sent, %llu EEPROM writes, most worn cell 0x%03X (%u writes)\n",
+            (unsigned long long)world->tx_bytes, (unsigned long long)world->eeprom_writes, worn, world->eeprom_wear[worn]);
+
+    if (eeprom_path) {
+        FILE* f = fopen(eeprom_path, "wb");
+        if (!f || fwrite(world->eeprom, 1, sizeof(world->eeprom), f) != sizeof(world->eeprom)) {
+            fail("%s: write error", eeprom_path);
+        }
+        fclose(f);
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_END ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,59 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "adc.h"
+
+#if ADC_ENABLE
+
+#define ADC_MUX_MASK 0x07
+
+static volatile uint8_t adc_channels = 0;    // One bit per enabled channel
+
+static void adc_convert(uint8_t channel) {
+    ADMUX = (1 << REFS1) | (1 << REFS0) | channel;   // Internal 2.56V reference
+    ADCSRA |= (1 << ADSC);
+}
+
+void adc_start(uint8_t channel) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        DDRA &= ~(1 << channel);
+        uint8_t idle = !adc_channels;
+        adc_channels |= 1 << channel;
+        if (idle) {
+            ADCSRA = (1 << ADEN) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+            adc_convert(channel);
+        }
+    }
+}
+
+void adc_stop(uint8_t channel) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        adc_channels &= ~(1 << channel);
+        if (!adc_channels) ADCSRA = 0;
+    }
+}
+
+ISR(ADC_vect) {
+    uint8_t channel = ADMUX & ADC_MUX_MASK;
+    uint16_t value = ADC;
+
+    // A channel stopped while its conversion ran has nobody to take the result
+    if (adc_channels & (1 << channel)) {
+#if CURRENT_SENSE_ENABLE
+        if (channel == CURRENT_SENSE_CHANNEL) current_sense_sample(value);
+#endif
+#if SUPPLY_MONITOR_ENABLE
+        if (channel == SUPPLY_CHANNEL) supply_sample(value);
+#endif
+    }
+
+    uint8_t channels = adc_channels;
+    if (!channels) return;
+    do {
+        channel = (channel + 1) & ADC_MUX_MASK;
+    } while (!(channels & (1 << channel)));
+    adc_convert(channel);
+}
+
+#endif
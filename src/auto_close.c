@@ -0,0 +1,50 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "auto_close.h"
+#include "rtc.h"
+
+#if AUTO_CLOSE_ENABLE
+
+static volatile uint16_t auto_close_left = 0;  // Seconds to go, 0 while disarmed
+static volatile bool auto_close_fired = false;
+
+void auto_close_arm(void) {
+    // Restart the second as well, so the countdown is AUTO_CLOSE_S to within 1/256s
+    TCNT2 = 0;
+    rtc_settle();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        auto_close_left = AUTO_CLOSE_S;
+        auto_close_fired = false;
+        TIFR = (1 << TOV2);
+        TIMSK |= (1 << TOIE2);
+    }
+}
+
+void auto_close_cancel(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        TIMSK &= ~(1 << TOIE2);
+        auto_close_left = 0;
+        auto_close_fired = false;
+    }
+}
+
+bool auto_close_armed(void) {
+    return TIMSK & (1 << TOIE2);
+}
+
+// True once when the countdown runs out
+bool auto_close_due(void) {
+    if (!auto_close_fired) return false;
+    auto_close_fired = false;
+    return true;
+}
+
+ISR(TIMER2_OVF_vect) {
+    if (--auto_close_left) return;
+    TIMSK &= ~(1 << TOIE2);
+    auto_close_fired = true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+
+#include "button.h"
+#include "event_queue.h"
+#include "instrument.h"
+#include "power.h"
+#include "timer.h"
+
+#if EVENT_QUEUE_SIZE - 1 <= BUTTON_BURST_EVENTS
+#error "The button queue must hold a burst of presses and leave room for noise"
+#endif
+
+#define BUTTON_IDLE 0
+#define BUTTON_PENDING 1             // Burst started, not held long enough yet
+#define BUTTON_HELD 2                // Confirmed, waiting for the release
+
+static volatile uint8_t button_state = BUTTON_IDLE;
+static event_queue_t button_queue;
+static volatile uint32_t button_low_ms = 0;     // First falling edge of the burst
+static volatile uint32_t button_high_ms = 0;    // Latest rising edge
+static uint32_t button_release_ms = 0;
+static bool button_released = false;
+static bool button_long = false;
+
+void button_init(void) {
+    DDRD &= ~(1 << BUTTON_PIN);
+    PORTD |= (1 << BUTTON_PIN);
+    GICR |= (1 << INT0);
+    MCUCR |= (1 << ISC00);                     // Any logical change
+    MCUCR &= ~(1 << ISC01);
+}
+
+// Noise only takes a slot while one is left for every press a burst can confirm
+static void button_post(uint8_t event) {
+    uint8_t keep_free = event == BUTTON_EVT_NOISE ? BUTTON_BURST_EVENTS : 0;
+    event_push(&button_queue, event, (uint16_t)millis(), keep_free);
+}
+
+// Called from the system tick ISR
+void button_tick(void) {
+    if (button_state == BUTTON_IDLE) return;
+
+    if (PIND & (1 << BUTTON_PIN)) {
+        if (!timer_elapsed(button_high_ms, BUTTON_GAP_MS)) return;
+        if (button_state == BUTTON_PENDING) {
+            button_post(BUTTON_EVT_NOISE);
+        } else {
+            button_release_ms = button_high_ms;
+            button_released = true;
+        }
+        button_state = BUTTON_IDLE;
+        return;
+    }
+
+    if (button_state == BUTTON_PENDING) {
+        if (timer_elapsed(button_low_ms, BUTTON_DEBOUNCE_DELAY)) {
+            bool twice = button_released && button_low_ms - button_release_ms < BUTTON_DOUBLE_MS;
+            button_post(twice ? BUTTON_EVT_DOUBLE : BUTTON_EVT_PRESS);
+            button_released = false;
+            button_long = false;
+            button_state = BUTTON_HELD;
+        }
+    } else if (!button_long && timer_elapsed(button_low_ms, BUTTON_LONG_MS)) {
+        button_post(BUTTON_EVT_LONG);
+        button_long = true;
+    }
+}
+
+// Oldest event not yet collected, BUTTON_EVT_NONE once the queue is empty
+uint8_t button_poll(void) {
+    event_t event;
+    // millis() needs cli(), so it is only read once there is something to collect
+    if (!event_pending(&button_queue) || !event_pop(&button_queue, &event, (uint16_t)millis())) {
+        return BUTTON_EVT_NONE;
+    }
+    return event.type;
+}
+
+// Events lost to a full queue, and the longest one waited to be collected
+uint8_t button_dropped(void) {
+    return button_queue.dropped;
+}
+
+uint8_t button_max_wait_ms(void) {
+    return button_queue.max_wait_ms;
+}
+
+void button_clear_stats(void) {
+    event_stats_clear(&button_queue);
+}
+
+// No burst being classified and nothing left to collect
+bool button_idle(void) {
+    return button_state == BUTTON_IDLE && !event_pending(&button_queue);
+}
+
+ISR(INT0_vect) {
+    // A press that woke the chip from power-save is stamped once millis() has caught up
+    power_wake();
+    if (PIND & (1 << BUTTON_PIN)) {
+        button_high_ms = millis();
+    } else if (button_state == BUTTON_IDLE) {
+        button_low_ms = millis();
+        button_state = BUTTON_PENDING;
+        instrument_edge();
+    }
+}
@@ -0,0 +1,108 @@
+#include <util/crc16.h>
+
+#include "command.h"
+#include "timer.h"
+#include "uart.h"
+
+#define PARSE_STX 0
+#define PARSE_ADDR 1
+#define PARSE_CMD 2
+#define PARSE_LEN 3
+#define PARSE_PAYLOAD 4
+#define PARSE_CRC 5
+
+static uint8_t parse_state = PARSE_STX;
+static uint8_t parse_crc = 0;
+static uint8_t parse_pos = 0;
+static uint32_t parse_last_ms = 0;
+static command_t parse_frame;
+static uint8_t reply_crc = 0;
+
+// Consume received bytes; true once a complete frame for this node is in `cmd`
+bool command_poll(command_t* cmd) {
+    if (parse_state != PARSE_STX && timer_elapsed(parse_last_ms, COMMAND_BYTE_TIMEOUT_MS)) {
+        parse_state = PARSE_STX;
+    }
+
+    while (uart_rx_available()) {
+        uint8_t c = uart_rx_read();
+        parse_last_ms = millis();
+
+        if (parse_state != PARSE_CRC) {
+            parse_crc = _crc8_ccitt_update(parse_crc, c);
+        }
+
+        switch (parse_state) {
+            case PARSE_STX:
+                if (c == COMMAND_STX) {
+                    parse_crc = 0;
+                    parse_state = PARSE_ADDR;
+                }
+                break;
+            case PARSE_ADDR:
+                parse_frame.addr = c;
+                parse_state = PARSE_CMD;
+                break;
+            case PARSE_CMD:
+                parse_frame.cmd = c;
+                parse_state = PARSE_LEN;
+                break;
+            case PARSE_LEN:
+                parse_frame.len = c;
+                parse_pos = 0;
+                if (c > COMMAND_MAX_PAYLOAD) {
+                    parse_state = PARSE_STX;
+                } else {
+                    parse_state = c ? PARSE_PAYLOAD : PARSE_CRC;
+                }
+                break;
+            case PARSE_PAYLOAD:
+                parse_frame.payload[parse_pos++] = c;
+                if (parse_pos == parse_frame.len) parse_state = PARSE_CRC;
+                break;
+            case PARSE_CRC:
+                parse_state = PARSE_STX;
+                if (c != parse_crc) break;
+                if (parse_frame.addr != COMMAND_NODE_ADDR && parse_frame.addr != COMMAND_BROADCAST_ADDR) break;
+                if (parse_frame.cmd & COMMAND_REPLY) break; // Another node's answer
+                *cmd = parse_frame;
+                return true;
+        }
+    }
+    return false;
+}
+
+// No frame half received and no byte waiting to be parsed
+bool command_idle(void) {
+    return parse_state == PARSE_STX && !uart_rx_available();
+}
+
+// Replies always wait for buffer space, even in drop-when-full builds
+bool command_reply_begin(const command_t* cmd, uint8_t len) {
+    if (cmd->addr == COMMAND_BROADCAST_ADDR) return false;
+
+    uart_tx_char_wait(COMMAND_STX);
+    reply_crc = 0;
+    command_reply_byte(COMMAND_NODE_ADDR);
+    command_reply_byte(cmd->cmd | COMMAND_REPLY);
+    command_reply_byte(len);
+    return true;
+}
+
+void command_reply_byte(uint8_t b) {
+    reply_crc = _crc8_ccitt_update(reply_crc, b);
+    uart_tx_char_wait(b);
+}
+
+void command_reply_end(void) {
+    uart_tx_char_wait(reply_crc);
+}
+
+void command_reply(const command_t* cmd, const uint8_t* payload, uint8_t len) {
+    if (!command_reply_begin(cmd, len)) return;
+
+    for (uint8_t i = 0; i < len; i++) {
+        command_reply_byte(payload[i]);
+    }
+    command_reply_end();
+}
@@ -0,0 +1,118 @@
+#include <util/atomic.h>
+
+#include "adc.h"
+#include "current_sense.h"
+#include "timer.h"
+
+#if CURRENT_SENSE_ENABLE
+
+#define CS_BLOCK_SHIFT 4                 // 16 ADC samples per block
+#define CS_WINDOW_SHIFT 3                // 8 blocks in the moving average
+#define CS_WINDOW (1 << CS_WINDOW_SHIFT)
+
+#define CS_BLANKING 0
+#define CS_LEARNING 1
+#define CS_ARMED 2
+
+static volatile uint16_t cs_block_sum = 0;
+static volatile uint8_t cs_block_count = 0;
+static volatile uint16_t cs_window[CS_WINDOW];
+static volatile uint16_t cs_window_sum = 0;
+static volatile uint8_t cs_window_idx = 0;
+static volatile uint16_t cs_filtered = 0;
+
+static uint8_t cs_phase = CS_BLANKING;
+static uint32_t cs_start_ms = 0;
+static uint32_t cs_learn_sum = 0;
+static uint16_t cs_learn_count = 0;
+static uint16_t cs_threshold = 0;
+static uint32_t cs_over_ms = 0;
+static bool cs_over = false;
+static uint32_t cs_last_sample_ms = 0;
+
+void current_sense_start(void) {
+    adc_stop(CURRENT_SENSE_CHANNEL);
+    cs_block_sum = 0;
+    cs_block_count = 0;
+    cs_window_sum = 0;
+    cs_window_idx = 0;
+    cs_filtered = 0;
+    for (uint8_t i = 0; i < CS_WINDOW; i++) cs_window[i] = 0;
+
+    cs_phase = CS_BLANKING;
+    cs_start_ms = millis();
+    cs_last_sample_ms = cs_start_ms;
+    cs_learn_sum = 0;
+    cs_learn_count = 0;
+    cs_over = false;
+
+    adc_start(CURRENT_SENSE_CHANNEL);
+}
+
+void current_sense_stop(void) {
+    adc_stop(CURRENT_SENSE_CHANNEL);
+}
+
+uint16_t current_sense_level(void) {
+    uint16_t level;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        level = cs_filtered;
+    }
+    return level;
+}
+
+// Polled from the motion state machine while the motor runs
+bool current_sense_stalled(void) {
+    uint32_t now = millis();
+    uint16_t level = current_sense_level();
+
+    switch (cs_phase) {
+        case CS_BLANKING:
+            if (timer_elapsed(cs_start_ms, CURRENT_INRUSH_MS)) {
+                cs_phase = CS_LEARNING;
+                cs_start_ms = now;
+            }
+            break;
+        case CS_LEARNING:
+            if (now != cs_last_sample_ms) {
+                cs_last_sample_ms = now;
+                cs_learn_sum += level;
+                cs_learn_count++;
+            }
+            if (timer_elapsed(cs_start_ms, CURRENT_LEARN_MS) && cs_learn_count > 0) {
+                uint16_t learned = cs_learn_sum / cs_learn_count;
+                cs_threshold = ((uint32_t)learned * CURRENT_STALL_RATIO_Q4) >> 4;
+                if (cs_threshold < CURRENT_STALL_MIN) cs_threshold = CURRENT_STALL_MIN;
+                cs_phase = CS_ARMED;
+            }
+            break;
+        case CS_ARMED:
+            if (level < cs_threshold) {
+                cs_over = false;
+            } else if (!cs_over) {
+                cs_over = true;
+                cs_over_ms = now;
+            } else if (timer_elapsed(cs_over_ms, CURRENT_STALL_CONFIRM_MS)) {
+                return true;
+            }
+            break;
+    }
+    return false;
+}
+
+// Called from ADC_vect with every conversion of the shunt channel
+void current_sense_sample(uint16_t value) {
+    cs_block_sum += value;
+    if (++cs_block_count < (1 << CS_BLOCK_SHIFT)) return;
+
+    uint16_t block = cs_block_sum >> CS_BLOCK_SHIFT;
+    cs_block_sum = 0;
+    cs_block_count = 0;
+
+    cs_window_sum += block - cs_window[cs_window_idx];
+    cs_window[cs_window_idx] = block;
+    cs_window_idx = (cs_window_idx + 1) & (CS_WINDOW - 1);
+    cs_filtered = cs_window_sum >> CS_WINDOW_SHIFT;
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+#include "eeprom_queue.h"
+#include "hal.h"
+
+typedef struct {
+    uint16_t addr;
+    uint8_t value;
+} ee_write_t;
+
+static volatile ee_write_t ee_queue[EE_QUEUE_SIZE];
+static volatile uint8_t ee_queue_head = 0;  // Written by the foreground only
+static volatile uint8_t ee_queue_tail = 0;  // Written by EE_RDY_vect only
+static volatile ee_write_t ee_urgent;        // Programmed ahead of the queue...
+static volatile bool ee_urgent_pending = false; // ...while this is set
+static volatile bool ee_reading = false;    // EERIE stays off until the read is done
+
+void ee_queue_write(uint16_t addr, uint8_t value) {
+    uint8_t next = (ee_queue_head + 1) & EE_QUEUE_MASK;
+
+    while (next == ee_queue_tail) hal_spin();
+
+    ee_queue[ee_queue_head].addr = addr;
+    ee_queue[ee_queue_head].value = value;
+    ee_queue_head = next;
+    EECR |= (1 << EERIE);
+}
+
+// Programs `value` ahead of every queued byte; safe to call from interrupt
+// context. A value not yet started is replaced by the next one.
+void ee_queue_urgent(uint16_t addr, uint8_t value) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ee_urgent.addr = addr;
+        ee_urgent.value = value;
+        ee_urgent_pending = true;
+        if (!ee_reading) EECR |= (1 << EERIE);
+    }
+}
+
+// True once every queued byte has been programmed
+uint8_t ee_queue_idle(void) {
+    return ee_queue_head == ee_queue_tail && !ee_urgent_pending && !(EECR & (1 << EEWE));
+}
+
+void ee_queue_flush(void) {
+    while (!ee_queue_idle()) hal_spin();
+}
+
+// Reads `len` bytes from `addr` as they will be once the queue has drained
+void ee_queue_read_block(void* dst, uint16_t addr, uint16_t len) {
+    uint8_t* bytes = dst;
+
+    // EE_RDY_vect could take EEAR between our wait and the read and start a
+    // write, which makes the read fail; keep it out until we're done
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        EECR &= ~(1 << EERIE);
+        ee_reading = true;
+    }
+    while (EECR & (1 << EEWE)) hal_spin();
+
+    for (uint16_t i = 0; i < len; i++) {
+        EEAR = addr + i;
+        EECR |= (1 << EERE);
+        bytes[i] = EEDR;
+    }
+
+    // Queued bytes land on top of what is programmed, the urgent one first
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint16_t offset = ee_urgent.addr - addr;
+        if (ee_urgent_pending && offset < len) bytes[offset] = ee_urgent.value;
+    }
+    for (uint8_t i = ee_queue_tail; i != ee_queue_head; i = (i + 1) & EE_QUEUE_MASK) {
+        uint16_t offset = ee_queue[i].addr - addr;
+        if (offset < len) bytes[offset] = ee_queue[i].value;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ee_reading = false;
+        if (ee_queue_head != ee_queue_tail || ee_urgent_pending) EECR |= (1 << EERIE);
+    }
+}
+
+uint8_t ee_queue_read(uint16_t addr) {
+    uint8_t value;
+    ee_queue_read_block(&value, addr, 1);
+    return value;
+}
+
+ISR(EE_RDY_vect) {
+    if (ee_urgent_pending) {
+        ee_urgent_pending = false;
+        EEAR = ee_urgent.addr;
+        EECR |= (1 << EERE);
+        if (EEDR != ee_urgent.value) {
+            EEDR = ee_urgent.value;
+            EECR |= (1 << EEMWE);
+            EECR |= (1 << EEWE);
+            return;
+        }
+    }
+
+    uint8_t tail = ee_queue_tail;
+
+    while (tail != ee_queue_head) {
+        EEAR = ee_queue[tail].addr;
+        uint8_t value = ee_queue[tail].value;
+        tail = (tail + 1) & EE_QUEUE_MASK;
+
+        EECR |= (1 << EERE);
+        if (EEDR == value) continue;
+
+        EEDR = value;
+        EECR |= (1 << EEMWE);
+        EECR |= (1 << EEWE);
+        ee_queue_tail = tail;
+        return;
+    }
+
+    ee_queue_tail = tail;
+    EECR &= ~(1 << EERIE);
+}
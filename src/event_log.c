@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <util/crc16.h>
+
+#include "eeprom_queue.h"
+#include "event_log.h"
+#include "timer.h"
+
+#define EVENT_LOG_CRC_SEED 0x3C
+
+static uint8_t event_log_slot = EVENT_LOG_SLOTS - 1;
+static uint8_t event_log_seq = 0;
+static bool event_log_valid = false;
+
+static uint16_t slot_addr(uint8_t slot) {
+    return EE_EVENT_LOG_START + (uint16_t)slot * EVENT_LOG_RECORD_SIZE;
+}
+
+static uint8_t record_crc(const uint8_t* rec) {
+    uint8_t crc = EVENT_LOG_CRC_SEED;
+    for (uint8_t i = 0; i < EVENT_LOG_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, rec[i]);
+    }
+    return crc;
+}
+
+void event_log_init(void) {
+    uint8_t rec[EVENT_LOG_RECORD_SIZE];
+
+    event_log_valid = false;
+    for (uint8_t slot = 0; slot < EVENT_LOG_SLOTS; slot++) {
+        ee_queue_read_block(rec, slot_addr(slot), sizeof(rec));
+        if (rec[EVENT_LOG_RECORD_SIZE - 1] != record_crc(rec)) continue;
+
+        if (!event_log_valid || (int8_t)(rec[0] - event_log_seq) > 0) {
+            event_log_seq = rec[0];
+            event_log_slot = slot;
+            event_log_valid = true;
+        }
+    }
+}
+
+// Sends all slots in one reply frame, records still queued included
+void event_log_dump(const command_t* cmd) {
+    uint8_t rec[EVENT_LOG_RECORD_SIZE];
+
+    if (!command_reply_begin(cmd, EVENT_LOG_SLOTS * EVENT_LOG_RECORD_SIZE)) return;
+
+    uint8_t slot = event_log_slot;
+    for (uint8_t i = 0; i < EVENT_LOG_SLOTS; i++) {
+        slot = (slot + 1) % EVENT_LOG_SLOTS;
+        ee_queue_read_block(rec, slot_addr(slot), sizeof(rec));
+        for (uint8_t j = 0; j < EVENT_LOG_RECORD_SIZE; j++) {
+            command_reply_byte(rec[j]);
+        }
+    }
+    command_reply_end();
+}
+
+void event_log_record(uint8_t evt, uint8_t arg) {
+    uint32_t seconds = millis() / 1000;
+    uint8_t rec[EVENT_LOG_RECORD_SIZE];
+
+    event_log_slot = (event_log_slot + 1) % EVENT_LOG_SLOTS;
+    event_log_seq = event_log_valid ? event_log_seq + 1 : 0;
+    event_log_valid = true;
+
+    rec[0] = event_log_seq;
+    rec[1] = evt;
+    rec[2] = arg;
+    rec[3] = (uint8_t)seconds;
+    rec[4] = (uint8_t)(seconds >> 8);
+    rec[5] = (uint8_t)(seconds >> 16);
+    rec[6] = (uint8_t)(seconds >> 24);
+    rec[7] = record_crc(rec);
+
+    // The CRC goes last so an interrupted write never produces a valid record
+    uint16_t addr = slot_addr(event_log_slot);
+    for (uint8_t i = 0; i < EVENT_LOG_RECORD_SIZE; i++) {
+        ee_queue_write(addr + i, rec[i]);
+    }
+}
@@ -0,0 +1,322 @@
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+
+#include "auto_close.h"
+#include "event_log.h"
+#include "gate.h"
+#include "hall.h"
+#include "journal.h"
+#include "log.h"
+#include "motion.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "travel.h"
+
+#if GATE_CHECKPOINT_STEP < 1 || GATE_CHECKPOINT_STEP > TRAVEL_POS_OPEN
+#error "GATE_CHECKPOINT_STEP must be between 1 and TRAVEL_POS_OPEN"
+#endif
+
+#define GATE_DO_STOP 0x01
+#define GATE_DO_ARRIVAL 0x02
+#define GATE_DO_OBSTRUCTION 0x04
+#define GATE_DO_RUN 0x08
+#define GATE_DO_STORE 0x10
+#define GATE_IF_PARTIAL 0x20
+#define GATE_DO_POWER_FAIL 0x40
+#define GATE_DO_AUTO_CLOSE 0x80
+
+#define NOTE_NONE 0
+#define NOTE_TOGGLE_OPEN 1
+#define NOTE_TOGGLE_REOPEN 2
+#define NOTE_TOGGLE_CLOSE 3
+#define NOTE_TOGGLE_RECLOSE 4
+#define NOTE_COMMAND_OPEN 5
+#define NOTE_COMMAND_CLOSE 6
+#define NOTE_STOPPED_OPENING 7
+#define NOTE_STOPPED_CLOSING 8
+#define NOTE_ARRIVED_OPEN 9
+#define NOTE_ARRIVED_CLOSED 10
+#define NOTE_REVERSING 11
+#define NOTE_AUTO_CLOSE 12
+
+#define GATE_OFFSET_STEP 8           // Journal position offset unit, of TRAVEL_POS_OPEN
+
+typedef struct {
+    uint8_t next;
+    uint8_t actions;
+    uint8_t note;
+} gate_transition_t;
+
+#define IGNORE(state) { state, 0, NOTE_NONE }
+
+static const gate_transition_t gate_table[GATE_EVENTS][GATE_STATES] PROGMEM = {
+    [GATE_EV_TOGGLE] = {
+        [GATE_CLOSED] = { GATE_OPENING, GATE_DO_RUN, NOTE_TOGGLE_OPEN },
+        [GATE_CLOSING] = { GATE_OPENING, GATE_DO_RUN, NOTE_TOGGLE_REOPEN },
+        [GATE_OPENING] = { GATE_CLOSING, GATE_DO_RUN, NOTE_TOGGLE_RECLOSE },
+        [GATE_OPEN] = { GATE_CLOSING, GATE_DO_RUN, NOTE_TOGGLE_CLOSE },
+    },
+    [GATE_EV_STOP] = {
+        [GATE_CLOSED] = IGNORE(GATE_CLOSED),
+        [GATE_CLOSING] = { GATE_CLOSED, GATE_DO_STOP | GATE_DO_STORE, NOTE_STOPPED_CLOSING },
+        [GATE_OPENING] = { GATE_OPEN, GATE_DO_STOP | GATE_DO_STORE, NOTE_STOPPED_OPENING },
+        [GATE_OPEN] = IGNORE(GATE_OPEN),
+    },
+    [GATE_EV_OPEN] = {
+        [GATE_CLOSED] = { GATE_OPENING, GATE_DO_RUN, NOTE_COMMAND_OPEN },
+        [GATE_CLOSING] = { GATE_OPENING, GATE_DO_RUN, NOTE_COMMAND_OPEN },
+        [GATE_OPENING] = IGNORE(GATE_OPENING),
+        [GATE_OPEN] = { GATE_OPENING, GATE_DO_RUN | GATE_IF_PARTIAL, NOTE_COMMAND_OPEN },
+    },
+    [GATE_EV_CLOSE] = {
+        [GATE_CLOSED] = { GATE_CLOSING, GATE_DO_RUN | GATE_IF_PARTIAL, NOTE_COMMAND_CLOSE },
+        [GATE_CLOSING] = IGNORE(GATE_CLOSING),
+        [GATE_OPENING] = { GATE_CLOSING, GATE_DO_RUN, NOTE_COMMAND_CLOSE },
+        [GATE_OPEN] = { GATE_CLOSING, GATE_DO_RUN, NOTE_COMMAND_CLOSE },
+    },
+    [GATE_EV_ARRIVED] = {
+        [GATE_CLOSED] = IGNORE(GATE_CLOSED),
+        [GATE_CLOSING] = { GATE_CLOSED, GATE_DO_ARRIVAL | GATE_DO_STORE, NOTE_ARRIVED_CLOSED },
+        [GATE_OPENING] = { GATE_OPEN, GATE_DO_ARRIVAL | GATE_DO_STORE | GATE_DO_AUTO_CLOSE, NOTE_ARRIVED_OPEN },
+        [GATE_OPEN] = IGNORE(GATE_OPEN),
+    },
+    [GATE_EV_OBSTRUCTED] = {
+        [GATE_CLOSED] = IGNORE(GATE_CLOSED),
+#if HALL_REVERSE_ON_OBSTRUCTION
+        [GATE_CLOSING] = { GATE_OPENING, GATE_DO_OBSTRUCTION | GATE_DO_RUN, NOTE_REVERSING },
+#else
+        [GATE_CLOSING] = { GATE_CLOSED, GATE_DO_OBSTRUCTION | GATE_DO_STORE, NOTE_NONE },
+#endif
+        // Same outcome as a button stop: assume the destination was reached
+        [GATE_OPENING] = { GATE_OPEN, GATE_DO_OBSTRUCTION | GATE_DO_STORE, NOTE_NONE },
+        [GATE_OPEN] = IGNORE(GATE_OPEN),
+    },
+    // Settle where a brown-out would have left it, see supply.h
+    [GATE_EV_POWER_FAIL] = {
+        [GATE_CLOSED] = IGNORE(GATE_CLOSED),
+        [GATE_CLOSING] = { GATE_CLOSED, GATE_DO_POWER_FAIL | GATE_DO_STORE, NOTE_STOPPED_CLOSING },
+        [GATE_OPENING] = { GATE_OPEN, GATE_DO_POWER_FAIL | GATE_DO_STORE, NOTE_STOPPED_OPENING },
+        [GATE_OPEN] = IGNORE(GATE_OPEN),
+    },
+    [GATE_EV_AUTO_CLOSE] = {
+        [GATE_CLOSED] = IGNORE(GATE_CLOSED),
+        [GATE_CLOSING] = IGNORE(GATE_CLOSING),
+        [GATE_OPENING] = IGNORE(GATE_OPENING),
+        [GATE_OPEN] = { GATE_CLOSING, GATE_DO_RUN, NOTE_AUTO_CLOSE },
+    },
+};
+
+// The state a run in progress settles to if it is cut short
+static const uint8_t gate_resting[GATE_STATES] PROGMEM = {
+    [GATE_CLOSED] = GATE_CLOSED,
+    [GATE_CLOSING] = GATE_CLOSED,
+    [GATE_OPENING] = GATE_OPEN,
+    [GATE_OPEN] = GATE_OPEN,
+};
+
+uint8_t gate_state = GATE_CLOSED;
+static uint16_t gate_checkpoint_pos = TRAVEL_POS_CLOSED;
+static uint8_t gate_auto_closes = 0;       // Auto-closes since the last user event
+
+void gate_init(void) {
+    gate_state = gate_stored_state();
+}
+
+uint8_t gate_stored_state(void) {
+    uint8_t state = journal_state();
+    return state < GATE_STATES ? pgm_read_byte(&gate_resting[state]) : GATE_CLOSED;
+}
+
+// Where the journal last saw the gate, stopped or on the move
+uint16_t gate_stored_position(void) {
+    uint16_t offset = (journal_flags() >> JOURNAL_OFFSET_SHIFT) * GATE_OFFSET_STEP;
+    if (offset > TRAVEL_POS_OPEN) offset = TRAVEL_POS_OPEN;
+    return gate_stored_state() == GATE_OPEN ? TRAVEL_POS_OPEN - offset : offset;
+}
+
+// How far past that a gate the journal saw moving may have got before it
+// stopped, positive when it was opening
+int16_t gate_stored_slack(void) {
+    uint8_t state = journal_state();
+    if (state == GATE_OPENING) return GATE_CHECKPOINT_STEP;
+    if (state == GATE_CLOSING) return -GATE_CHECKPOINT_STEP;
+    return 0;
+}
+
+static void gate_store_at(uint16_t position) {
+    uint8_t resting = pgm_read_byte(&gate_resting[gate_state]);
+    uint16_t offset = resting == GATE_OPEN ? TRAVEL_POS_OPEN - position : position;
+    offset = (offset + GATE_OFFSET_STEP / 2) / GATE_OFFSET_STEP;
+    if (offset > JOURNAL_OFFSET_MAX) offset = JOURNAL_OFFSET_MAX;
+
+    uint8_t flags = (journal_flags() & JOURNAL_FLAG_RESET) | (uint8_t)(offset << JOURNAL_OFFSET_SHIFT);
+    journal_write(gate_state, flags);
+}
+
+// Journals gate_state with how far the gate sits from the end it rests at
+void gate_store(void) {
+    gate_store_at(travel_position());
+}
+
+// Polled from the main loop; journals progress while the motor runs
+void gate_checkpoint(void) {
+    if (gate_state != GATE_OPENING && gate_state != GATE_CLOSING) return;
+
+    uint16_t position = motion_position();
+    // The stop record follows at once
+    if (position == TRAVEL_POS_OPEN || position == TRAVEL_POS_CLOSED) return;
+
+    uint16_t moved = position > gate_checkpoint_pos ? position - gate_checkpoint_pos : gate_checkpoint_pos - position;
+    if (moved < GATE_CHECKPOINT_STEP) return;
+
+    gate_checkpoint_pos = position;
+    gate_store_at(position);
+}
+
+void gate_report(void) {
+    switch (gate_state) {
+        case GATE_CLOSED:
+            LOG_EVENT(INFO, EVT_STATE, GATE_CLOSED, "State: Gate Closed\r\n");
+            break;
+        case GATE_CLOSING:
+            LOG_EVENT(INFO, EVT_STATE, GATE_CLOSING, "State: Gate Closing\r\n");
+            break;
+        case GATE_OPENING:
+            LOG_EVENT(INFO, EVT_STATE, GATE_OPENING, "State: Gate Opening\r\n");
+            break;
+        case GATE_OPEN:
+            LOG_EVENT(INFO, EVT_STATE, GATE_OPEN, "State: Gate Open\r\n");
+            break;
+    }
+}
+
+static void gate_note(uint8_t note) {
+    switch (note) {
+        case NOTE_TOGGLE_OPEN:
+            LOG_EVENT(INFO, EVT_TOGGLE_OPEN, gate_state, "Gate currently closed, opening\r\n");
+            break;
+        case NOTE_TOGGLE_REOPEN:
+            LOG_EVENT(INFO, EVT_TOGGLE_OPEN, gate_state, "Gate currently closing, changing direction to opening\r\n");
+            break;
+        case NOTE_TOGGLE_CLOSE:
+            LOG_EVENT(INFO, EVT_TOGGLE_CLOSE, gate_state, "Gate currently open, closing\r\n");
+            break;
+        case NOTE_TOGGLE_RECLOSE:
+            LOG_EVENT(INFO, EVT_TOGGLE_CLOSE, gate_state, "Gate currently opening, changing direction to closing\r\n");
+            break;
+        case NOTE_COMMAND_OPEN:
+            LOG_EVENT(INFO, EVT_COMMAND_OPEN, gate_state, "Remote command: open\r\n");
+            break;
+        case NOTE_COMMAND_CLOSE:
+            LOG_EVENT(INFO, EVT_COMMAND_CLOSE, gate_state, "Remote command: close\r\n");
+            break;
+        case NOTE_STOPPED_OPENING:
+            LOG_TEXT(INFO, "Gate movement interrupted while opening. Considering gate open\r\n");
+            break;
+        case NOTE_STOPPED_CLOSING:
+            LOG_TEXT(INFO, "Gate movement interrupted while closing. Considering gate closed\r\n");
+            break;
+        case NOTE_ARRIVED_OPEN:
+            if (motion_at_endstop()) {
+                LOG_EVENT(INFO, EVT_ENDSTOP, gate_state, "Endstop reached, gate fully open\r\n");
+            } else {
+                LOG_EVENT(INFO, EVT_TRAVEL_ELAPSED, gate_state, "Travel time elapsed, setting gate to fully open\r\n");
+            }
+            break;
+        case NOTE_ARRIVED_CLOSED:
+            if (motion_at_endstop()) {
+                LOG_EVENT(INFO, EVT_ENDSTOP, gate_state, "Endstop reached, gate fully closed\r\n");
+            } else {
+                LOG_EVENT(INFO, EVT_TRAVEL_ELAPSED, gate_state, "Travel time elapsed, setting gate to fully closed\r\n");
+            }
+            break;
+        case NOTE_REVERSING:
+            LOG_TEXT(INFO, "Reversing to fully open\r\n");
+            break;
+        case NOTE_AUTO_CLOSE:
+            LOG_EVENT(INFO, EVT_AUTO_CLOSE, gate_state, "Auto-close time elapsed, closing\r\n");
+            break;
+    }
+}
+
+static void gate_lookup(uint8_t event, gate_transition_t* t) {
+    memcpy_P(t, &gate_table[event][gate_state], sizeof(*t));
+}
+
+static bool gate_allows(const gate_transition_t* t) {
+    if (!t->actions) return false;
+    if (t->actions & GATE_IF_PARTIAL) {
+        uint16_t end = gate_state == GATE_OPEN ? TRAVEL_POS_OPEN : TRAVEL_POS_CLOSED;
+        if (travel_position() == end) return false;
+    }
+    return true;
+}
+
+// False if the event would be ignored in the current state
+bool gate_accepts(uint8_t event) {
+    gate_transition_t t;
+    gate_lookup(event, &t);
+    return gate_allows(&t);
+}
+
+bool gate_dispatch(uint8_t event) {
+    gate_transition_t t;
+    gate_lookup(event, &t);
+    if (!gate_allows(&t)) {
+        // At rest, a stop holds an open gate open and an open restarts the countdown
+        if (auto_close_armed() && event == GATE_EV_STOP) {
+            auto_close_cancel();
+            LOG_TEXT(INFO, "Auto-close cancelled\r\n");
+        } else if (auto_close_armed() && event == GATE_EV_OPEN) {
+            auto_close_arm();
+        }
+        return false;
+    }
+
+    wdt_reset();
+    auto_close_cancel();
+    if (event == GATE_EV_AUTO_CLOSE) {
+        gate_auto_closes++;
+    } else if (event <= GATE_EV_CLOSE) {
+        gate_auto_closes = 0;              // Button and commands start the count again
+    }
+
+    if (t.actions & GATE_DO_STOP) {
+        motion_stop();
+        LOG_EVENT(WARN, EVT_EMERGENCY_STOP, gate_state, "Emergency stop: gate halted immediately\r\n");
+        event_log_record(EVT_EMERGENCY_STOP, gate_state);
+    }
+    if (t.actions & GATE_DO_ARRIVAL) {
+        event_log_record(motion_at_endstop() ? EVT_ENDSTOP : EVT_TRAVEL_ELAPSED, gate_state);
+    }
+    if (t.actions & GATE_DO_OBSTRUCTION) {
+        LOG_EVENT(ERROR, EVT_OBSTRUCTION, gate_state, "Obstruction detected: motor stopped short of the end of travel\r\n");
+        event_log_record(EVT_OBSTRUCTION, gate_state);
+    }
+    if (t.actions & GATE_DO_POWER_FAIL) {
+        LOG_EVENT(ERROR, EVT_POWER_FAIL, gate_state, "Supply sagging: relays cut, position saved\r\n");
+        event_log_record(EVT_POWER_FAIL, gate_state);
+    }
+    gate_note(t.note);
+
+    if (t.actions & GATE_DO_RUN) {
+        uint8_t direction = t.next == GATE_OPENING ? MOTION_DIR_OPEN : MOTION_DIR_CLOSE;
+        motion_start(direction, travel_run_time(direction));
+        event_log_record(EVT_MOTION_START, t.next);
+        gate_checkpoint_pos = travel_position();
+    }
+
+    gate_state = t.next;
+    // A run journals its moving state from the start, so a power cut in its
+    // first step still comes back with the slack
+    if (t.actions & (GATE_DO_STORE | GATE_DO_RUN)) {
+        gate_store();
+    }
+    gate_report();
+
+    if ((t.actions & GATE_DO_AUTO_CLOSE) && AUTO_CLOSE_ENABLE && gate_auto_closes < AUTO_CLOSE_ATTEMPTS) {
+        auto_close_arm();
+        LOG_TEXT(DEBUG, "Auto-close armed\r\n");
+    }
+    return true;
+}
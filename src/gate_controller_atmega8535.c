@@ -1,10 +1,31 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/eeprom.h>
-#include <util/delay.h>
 #include <avr/wdt.h>
 #include <stdbool.h>
 #include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#include "auto_close.h"
+#include "button.h"
+#include "command.h"
+#include "eeprom_queue.h"
+#include "event_log.h"
+#include "gate.h"
+#include "hal.h"
+#include "hall.h"
+#include "health.h"
+#include "instrument.h"
+#include "journal.h"
+#include "motion.h"
+#include "log.h"
+#include "power.h"
+#include "rtc.h"
+#include "stats.h"
+#include "supply.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "travel.h"
+#include "uart.h"
 
 /*
  * Gate Controller Firmware for ATmega8535
@@ -12,7 +33,7 @@
  * Controls a relay-based H-bridge motor to open/close a gate using a momentary push button.
  * - A single button press toggles the gate between open and closed.
  * - Pressing the button while the gate is moving will immediately stop it and assume the destination state.
- * - Includes a watchdog timer for crash recovery and optional scheduled resets to maintain long-term stability.
+ * - Includes a watchdog timer for crash recovery and a health supervisor that resets only when it finds a fault.
  * 
  * Author: Alex Findlay
  * Date: 2025-03-23
@@ -20,377 +41,352 @@
  * Repository: https://github.com/lnxd
  */
 
-#define F_CPU 8000000UL
-#define BAUD 9600
-#define UBRR_VALUE ((F_CPU / (16UL * BAUD)) - 1)
-
 #define WDT_TIMEOUT WDTO_1S          // 1 second timeout
-#define REGULAR_RESET_HOURS 6        // Reset every 6 hours if idle
-#define MS_PER_HOUR 3600000UL        // Number of milliseconds in an hour
-
-#define GATE_OPERATION_TIME 30000    // 30 seconds for gate to fully open/close
-#define RELAY_SWITCHING_DELAY 100    // 100ms delay between relay operations
-#define BUTTON_DEBOUNCE_DELAY 250    // 250ms for button debounce
-#define SHORT_DELAY 10               // 10ms for short delays in loops
-#define RESET_DELAY 5000             // 5 seconds before controlled reset
-
-#define RELAY_K1 PB0
-#define RELAY_K2 PB1
-#define RELAY_K3 PB2
-#define RELAY_K4 PB3
-#define BUTTON_PIN PD2
-#define LED_OPENING PD4
-#define LED_CLOSING PD5
-
-#define EEPROM_ADDR 0x00
-#define EEPROM_RESET_FLAG 0x01
-
-#define GATE_CLOSED 0
-#define GATE_CLOSING 1
-#define GATE_OPENING 2
-#define GATE_OPEN 3
-
-void uart_init(void);
-void uart_tx_char(char c);
-void uart_tx_string(const char* str);
-void uart_tx_string_P(const char* str);
+
+#define BOOT_REPORT_LAST 12          // Last step of boot_report_poll()
+#define BOOT_REPORT_LINE_MAX 44      // Longest boot banner line
+
+// A smaller TX ring waits until it is empty and parks the rest of the line
+#if BOOT_REPORT_LINE_MAX < UART_TX_MASK
+#define BOOT_REPORT_ROOM BOOT_REPORT_LINE_MAX
+#else
+#define BOOT_REPORT_ROOM UART_TX_MASK
+#endif
+
 void init_watchdog(void);
 void reset_watchdog(void);
-void schedule_reset(void);
 void perform_controlled_reset(void);
+void health_fault(uint8_t fault);
 void init_io(void);
 void init_interrupts(void);
-uint8_t read_gate_state(void);
-void write_gate_state(uint8_t state);
 uint8_t check_reset_flag(void);
-void indicate_opening(void);
-void indicate_closing(void);
-void indicate_stop(void);
-void report_state(void);
-void stop_gate(void);
-void open_gate(void);
-void close_gate(void);
-void toggle_gate(void);
-void emergency_stop(void);
-
-volatile uint8_t gate_state;
-volatile uint8_t button_pressed = 0;
-volatile uint8_t gate_moving = 0;
-volatile uint32_t idle_timer_ms = 0;
-volatile uint8_t reset_scheduled = 0;
-
-void uart_init(void) {
-    UBRRH = (uint8_t)(UBRR_VALUE >> 8);
-    UBRRL = (uint8_t)(UBRR_VALUE);
-    UCSRB = (1 << TXEN);
-    UCSRC = (1 << URSEL) | (1 << UCSZ1) | (1 << UCSZ0);
-}
-
-void uart_tx_char(char c) {
-    while (!(UCSRA & (1 << UDRE)));
-    UDR = c;
-}
-
-void uart_tx_string(const char* str) {
-    while (*str) {
-        uart_tx_char(*str++);
-    }
-}
-
-void uart_tx_string_P(const char* str) {
-    char c;
-    while ((c = pgm_read_byte(str++))) {
-        uart_tx_char(c);
-    }
-}
+void migrate_journal(void);
+uint8_t recover_power_fail(void);
+void handle_button(uint8_t event);
+void handle_command(const command_t* cmd);
+void boot_report_poll(void);
+
+uint8_t boot_mcucsr;
+uint8_t boot_recovered;
+uint8_t boot_power_fail;
+uint16_t boot_ready_us;
+uint8_t boot_report_step = 0;
 
 void init_watchdog(void) {
     wdt_reset();
     wdt_enable(WDT_TIMEOUT);
-    uart_tx_string_P(PSTR("Watchdog timer enabled.\r\n"));
 }
 
 void reset_watchdog(void) {
     wdt_reset();
 }
 
-void schedule_reset(void) {
-    if (!gate_moving && !reset_scheduled) {
-        uart_tx_string_P(PSTR("Scheduled reset after 6 hours of inactivity\r\n"));
-        reset_scheduled = 1;
-        idle_timer_ms = 0;
-    }
-}
-
 void perform_controlled_reset(void) {
-    uart_tx_string_P(PSTR("Performing controlled system reset\r\n"));
+    LOG_EVENT(WARN, EVT_RESET_CONTROLLED, gate_state, "Performing controlled system reset\r\n");
+    event_log_record(EVT_RESET_CONTROLLED, gate_state);
     
-    if (gate_moving) {
-        stop_gate();
+    if (motion_busy()) {
+        motion_stop();
     }
     
-    eeprom_write_byte((uint8_t*)EEPROM_RESET_FLAG, 1);
+    journal_write(gate_stored_state(), journal_flags() | JOURNAL_FLAG_RESET);
+    stats_flush();
+    ee_queue_flush();
+    uart_flush();
     
     wdt_enable(WDTO_15MS);
-    while(1);
+    while(1) hal_spin();
+}
+
+void health_fault(uint8_t fault) {
+    switch (fault) {
+        case HEALTH_TICK:
+            LOG_EVENT(ERROR, EVT_HEALTH_FAULT, fault, "Health fault: system tick stopped\r\n");
+            break;
+        case HEALTH_STACK:
+            LOG_EVENT(ERROR, EVT_HEALTH_FAULT, fault, "Health fault: stack nearly exhausted\r\n");
+            break;
+        case HEALTH_REGISTERS:
+            LOG_EVENT(ERROR, EVT_HEALTH_FAULT, fault, "Health fault: peripheral register corrupted\r\n");
+            break;
+        case HEALTH_UART:
+            LOG_EVENT(ERROR, EVT_HEALTH_FAULT, fault, "Health fault: UART transmitter stalled\r\n");
+            break;
+        default:
+            LOG_EVENT(ERROR, EVT_HEALTH_FAULT, fault, "Health fault: gate state corrupted\r\n");
+            break;
+    }
+    event_log_record(EVT_HEALTH_FAULT, fault);
+    perform_controlled_reset();
 }
 
 void init_io(void) {
-    DDRB |= (1 << RELAY_K1) | (1 << RELAY_K2) | (1 << RELAY_K3) | (1 << RELAY_K4);
-    DDRD |= (1 << LED_OPENING) | (1 << LED_CLOSING);
-    DDRD &= ~(1 << BUTTON_PIN);
-    PORTD |= (1 << BUTTON_PIN);
+    motion_init();
+    power_init();
 }
 
 void init_interrupts(void) {
-    GICR |= (1 << INT0);
-    MCUCR |= (1 << ISC01);
-    MCUCR &= ~(1 << ISC00);
+    timer_init();
+    instrument_init();
+    rtc_init();
+    hall_init();
+    button_init();
     sei();
 }
 
-uint8_t read_gate_state(void) {
-    uint8_t state = eeprom_read_byte((uint8_t*)EEPROM_ADDR);
-    if (state == GATE_CLOSING) state = GATE_CLOSED;
-    if (state == GATE_OPENING) state = GATE_OPEN;
-    return state;
-}
-
-void write_gate_state(uint8_t state) {
-    if (read_gate_state() != state) {
-        eeprom_write_byte((uint8_t*)EEPROM_ADDR, state);
+void migrate_journal(void) {
+    if (journal_state() == JOURNAL_EMPTY) {
+        // First boot after upgrading from the fixed-address layout
+        uint8_t state = ee_queue_read(EE_LEGACY_STATE);
+        uint8_t flags = ee_queue_read(EE_LEGACY_RESET_FLAG) == 1 ? JOURNAL_FLAG_RESET : 0;
+        journal_write(state > GATE_OPEN ? GATE_CLOSED : state, flags);
     }
 }
 
 uint8_t check_reset_flag(void) {
-    uint8_t flag = eeprom_read_byte((uint8_t*)EEPROM_RESET_FLAG);
-    if (flag != 0) {
-        eeprom_write_byte((uint8_t*)EEPROM_RESET_FLAG, 0);
+    uint8_t flags = journal_flags();
+    if (flags & JOURNAL_FLAG_RESET) {
+        journal_write(journal_state(), flags & ~JOURNAL_FLAG_RESET);
     }
-    return flag;
+    return flags & JOURNAL_FLAG_RESET;
 }
 
-void indicate_opening(void) {
-    PORTD |= (1 << LED_OPENING);
-    PORTD &= ~(1 << LED_CLOSING);
+// Resumes exactly where a brown-out cut the last run short, if it did
+uint8_t recover_power_fail(void) {
+    uint8_t direction;
+    uint16_t position;
+    if (!supply_recover(&direction, &position)) return 0;
+
+    gate_state = direction == MOTION_DIR_OPEN ? GATE_OPEN : GATE_CLOSED;
+    travel_set_position(position);
+    gate_store();
+    event_log_record(EVT_POWER_FAIL, gate_state);
+    return 1;
 }
 
-void indicate_closing(void) {
-    PORTD |= (1 << LED_CLOSING);
-    PORTD &= ~(1 << LED_OPENING);
-}
-
-void indicate_stop(void) {
-    PORTD &= ~((1 << LED_OPENING) | (1 << LED_CLOSING));
-}
-
-void report_state(void) {
-    switch (gate_state) {
-        case GATE_CLOSED:
-            uart_tx_string_P(PSTR("State: Gate Closed\r\n"));
-            break;
-        case GATE_CLOSING:
-            uart_tx_string_P(PSTR("State: Gate Closing\r\n"));
+void handle_button(uint8_t event) {
+    power_activity();
+    switch (event) {
+        case BUTTON_EVT_PRESS:
+        case BUTTON_EVT_DOUBLE:
+            // A quick second press still stops, then reverses, as it always has
+            instrument_decision(true);
+            gate_dispatch(motion_busy() ? GATE_EV_STOP : GATE_EV_TOGGLE);
             break;
-        case GATE_OPENING:
-            uart_tx_string_P(PSTR("State: Gate Opening\r\n"));
+        case BUTTON_EVT_LONG:
+            // Hold to stop part way, e.g. a pedestrian opening
+            if (motion_busy()) gate_dispatch(GATE_EV_STOP);
             break;
-        case GATE_OPEN:
-            uart_tx_string_P(PSTR("State: Gate Open\r\n"));
+        case BUTTON_EVT_NOISE:
+            LOG_EVENT(DEBUG, EVT_BUTTON_NOISE, gate_state, "Input noise ignored\r\n");
             break;
     }
 }
 
-void stop_gate(void) {
-    PORTB &= ~((1 << RELAY_K1) | (1 << RELAY_K2) | (1 << RELAY_K3) | (1 << RELAY_K4));
-    indicate_stop();
-    gate_moving = 0;
-}
+void handle_command(const command_t* cmd) {
+    uint8_t result = CMD_RESULT_OK;
+    uint8_t event = GATE_EVENTS;
 
-void open_gate(void) {
-    stop_gate();
-    reset_watchdog();
-    _delay_ms(RELAY_SWITCHING_DELAY);
-    PORTB |= (1 << RELAY_K1) | (1 << RELAY_K4);
-    indicate_opening();
-    gate_state = GATE_OPENING;
-    report_state();
-    gate_moving = 1;
-    idle_timer_ms = 0;
-    reset_scheduled = 0;
-
-    for (uint16_t i = 0; i < GATE_OPERATION_TIME; i += SHORT_DELAY) {
-        _delay_ms(SHORT_DELAY);
-        reset_watchdog();
-        if (!gate_moving) return;
-    }
+    power_activity();
 
-    stop_gate();
-    gate_state = GATE_OPEN;
-    write_gate_state(gate_state);
-    report_state();
-    uart_tx_string_P(PSTR("30 seconds have passed, setting gate to fully open\r\n"));
-}
-
-void close_gate(void) {
-    stop_gate();
-    reset_watchdog();
-    _delay_ms(RELAY_SWITCHING_DELAY);
-    PORTB |= (1 << RELAY_K2) | (1 << RELAY_K3);
-    indicate_closing();
-    gate_state = GATE_CLOSING;
-    report_state();
-    gate_moving = 1;
-    idle_timer_ms = 0;
-    reset_scheduled = 0;
-
-    for (uint16_t i = 0; i < GATE_OPERATION_TIME; i += SHORT_DELAY) {
-        _delay_ms(SHORT_DELAY);
-        reset_watchdog();
-        if (!gate_moving) return;
+    switch (cmd->cmd) {
+        case CMD_OPEN:
+            event = GATE_EV_OPEN;
+            break;
+        case CMD_CLOSE:
+            event = GATE_EV_CLOSE;
+            break;
+        case CMD_STOP:
+            event = GATE_EV_STOP;
+            break;
+        case CMD_STATUS:
+            break;
+        case CMD_BOOT: {
+            uint8_t reply[3] = { (uint8_t)boot_ready_us, (uint8_t)(boot_ready_us >> 8), boot_mcucsr };
+            command_reply(cmd, reply, sizeof(reply));
+            return;
+        }
+#if TELEMETRY_BINARY
+        case CMD_EVENTS: {
+            uint8_t events[1 + TELEMETRY_MAX_PER_REPLY * TELEMETRY_RECORD_SIZE];
+            command_reply(cmd, events, telemetry_drain(events, TELEMETRY_MAX_PER_REPLY));
+            return;
+        }
+#endif
+        case CMD_EVENT_LOG:
+            // Streaming the ring holds the loop up for too long to run the motor
+            if (motion_busy()) {
+                result = CMD_RESULT_BUSY;
+                break;
+            }
+            event_log_dump(cmd);
+            return;
+        case CMD_STATS:
+            stats_report(cmd);
+            return;
+#if INSTRUMENT_ENABLE
+        case CMD_INSTRUMENT:
+            instrument_report(cmd);
+            return;
+#endif
+        default:
+            result = CMD_RESULT_UNKNOWN;
+            break;
     }
 
-    stop_gate();
-    gate_state = GATE_CLOSED;
-    write_gate_state(gate_state);
-    report_state();
-    uart_tx_string_P(PSTR("30 seconds have passed, setting gate to fully closed\r\n"));
-}
-
-void toggle_gate(void) {
-    reset_watchdog();
-    idle_timer_ms = 0;
-    reset_scheduled = 0;
-    
-    if (gate_state == GATE_CLOSED || gate_state == GATE_CLOSING) {
-        if (gate_state == GATE_CLOSING) {
-            uart_tx_string_P(PSTR("Gate currently closing, changing direction to opening\r\n"));
-        } else {
-            uart_tx_string_P(PSTR("Gate currently closed, opening\r\n"));
+    if (event != GATE_EVENTS) {
+        if (gate_accepts(event)) {
+            instrument_decision(false);
         }
-        open_gate();
-    } else {
-        if (gate_state == GATE_OPENING) {
-            uart_tx_string_P(PSTR("Gate currently opening, changing direction to closing\r\n"));
-        } else {
-            uart_tx_string_P(PSTR("Gate currently open, closing\r\n"));
+        // Dispatched either way, an ignored stop or open still steers auto-close
+        if (!gate_dispatch(event)) {
+            result = CMD_RESULT_NO_CHANGE;
         }
-        close_gate();
     }
-}
 
-void emergency_stop(void) {
-    uart_tx_string_P(PSTR("Emergency stop: gate halted immediately\r\n"));
-    stop_gate();
-    reset_watchdog();
-    idle_timer_ms = 0;
-    reset_scheduled = 0;
-    
-    if (gate_state == GATE_OPENING) {
-        gate_state = GATE_OPEN;
-        uart_tx_string_P(PSTR("Gate movement interrupted while opening. Considering gate open\r\n"));
-    } else if (gate_state == GATE_CLOSING) {
-        gate_state = GATE_CLOSED;
-        uart_tx_string_P(PSTR("Gate movement interrupted while closing. Considering gate closed\r\n"));
-    }
-    
-    write_gate_state(gate_state);
-    report_state();
+    uint16_t position = travel_position();
+    uint8_t reply[5] = { result, gate_state, motion_busy(), (uint8_t)position, (uint8_t)(position >> 8) };
+    command_reply(cmd, reply, sizeof(reply));
 }
 
-ISR(INT0_vect) {
-    _delay_ms(BUTTON_DEBOUNCE_DELAY); // Debounce
-    reset_watchdog();
-    
-    if (!(PIND & (1 << BUTTON_PIN))) {
-        while (!(PIND & (1 << BUTTON_PIN))) {
-            _delay_ms(SHORT_DELAY);
-            reset_watchdog();
-        }
-
-        idle_timer_ms = 0;
-        reset_scheduled = 0;
+// Replays the boot banner one line per pass, and only while the TX ring has
+// room for it, so a reset never leaves the loop waiting on the UART
+void boot_report_poll(void) {
+    if (boot_report_step > BOOT_REPORT_LAST || uart_tx_free() < BOOT_REPORT_ROOM) return;
 
-        if (gate_moving) {
-            emergency_stop();
-            return;
-        }
-
-        button_pressed = 1;
+    switch (boot_report_step++) {
+        case 0:
+            LOG_EVENT(INFO, EVT_BOOT, gate_state, "ATMega8535 booting\r\n");
+            break;
+        case 1:
+            LOG_TEXT(DEBUG, "I/O initialized\r\n");
+            break;
+        case 2:
+            LOG_TEXT(DEBUG, "Interrupts enabled\r\n");
+            break;
+        case 3:
+            LOG_TEXT(DEBUG, "Watchdog timer enabled.\r\n");
+            break;
+        case 4:
+            if (boot_mcucsr & (1 << WDRF)) {
+                LOG_EVENT(ERROR, EVT_RESET_WATCHDOG, gate_state, "System restarted via watchdog reset\r\n");
+            }
+            break;
+        case 5:
+            if (boot_mcucsr & (1 << PORF)) {
+                LOG_EVENT(INFO, EVT_RESET_POWER_ON, gate_state, "System experienced a power-on reset\r\n");
+            }
+            break;
+        case 6:
+            if (boot_mcucsr & (1 << EXTRF)) {
+                LOG_EVENT(WARN, EVT_RESET_EXTERNAL, gate_state, "System experienced an external reset\r\n");
+            }
+            break;
+        case 7:
+            if (boot_mcucsr & (1 << BORF)) {
+                LOG_EVENT(ERROR, EVT_RESET_BROWN_OUT, gate_state, "System experienced a brown-out reset\r\n");
+            }
+            break;
+        case 8:
+            if (boot_recovered) {
+                LOG_EVENT(INFO, EVT_RESET_RECOVERED, gate_state, "System recovered from controlled reset\r\n");
+            }
+            break;
+        case 9:
+            if (boot_power_fail) {
+                LOG_EVENT(INFO, EVT_POWER_FAIL, gate_state, "Position restored from power-fail record\r\n");
+            }
+            break;
+        case 10:
+            LOG_TEXT(DEBUG, "EEPROM read complete\r\n");
+            break;
+        case 11:
+            LOG_EVENT(INFO, EVT_READY, gate_state, "ATMega8535 ready\r\n");
+            break;
+        case BOOT_REPORT_LAST:
+            gate_report();
+            break;
     }
 }
 
 int main(void) {
+    health_init();
     init_io();
     uart_init();
-
-    uart_tx_string_P(PSTR("ATMega8535 booting\r\n"));
-    uart_tx_string_P(PSTR("I/O initialized\r\n"));
-
-    init_interrupts();
-    uart_tx_string_P(PSTR("Interrupts enabled\r\n"));
-
-    uint8_t mcucsr_value = MCUCSR;
-    
-    if (mcucsr_value & (1 << WDRF)) {
-        uart_tx_string_P(PSTR("System restarted via watchdog reset\r\n"));
-        MCUCSR &= ~(1 << WDRF);
-    }
-    
-    if (mcucsr_value & (1 << PORF)) {
-        uart_tx_string_P(PSTR("System experienced a power-on reset\r\n"));
-        MCUCSR &= ~(1 << PORF);
-    }
-    
-    if (mcucsr_value & (1 << EXTRF)) {
-        uart_tx_string_P(PSTR("System experienced an external reset\r\n"));
-        MCUCSR &= ~(1 << EXTRF);
-    }
-    
-    if (mcucsr_value & (1 << BORF)) {
-        uart_tx_string_P(PSTR("System experienced a brown-out reset\r\n"));
-        MCUCSR &= ~(1 << BORF);
-    }
-
-    if (check_reset_flag()) {
-        uart_tx_string_P(PSTR("System recovered from controlled reset\r\n"));
-    }
-
-    gate_state = read_gate_state();
-    uart_tx_string_P(PSTR("EEPROM read complete\r\n"));
-
+    init_interrupts(); // INT0 is armed from here, presses are latched until the main loop runs
     init_watchdog();
 
-    uart_tx_string_P(PSTR("ATMega8535 ready\r\n"));
-    report_state();
-
-    uint16_t ms_counter = 0;
+    boot_mcucsr = MCUCSR;
+    MCUCSR &= ~((1 << WDRF) | (1 << PORF) | (1 << EXTRF) | (1 << BORF));
+
+    // Every read before the first write is queued: a read has to wait out
+    // a write in progress, up to 8.5ms for each one queued ahead of it
+    journal_init();
+    event_log_init();
+    stats_init();
+    travel_init();
+    supply_init();
+    migrate_journal();
+
+    event_log_record(EVT_BOOT, boot_mcucsr);
+    boot_recovered = check_reset_flag();
+    gate_init();
+    travel_set_position(gate_stored_position());
+    travel_set_slack(gate_stored_slack());
+    boot_power_fail = recover_power_fail();
+
+    // Nothing above waits on the UART; the banner follows from boot_report_poll()
+    uint32_t ready_us = micros();
+    boot_ready_us = ready_us > UINT16_MAX ? UINT16_MAX : (uint16_t)ready_us;
+
+    set_sleep_mode(SLEEP_MODE_IDLE);
     
     while (1) {
+        instrument_loop();
         reset_watchdog();
         
-        if (button_pressed) {
-            button_pressed = 0;
-            toggle_gate();
+        uint8_t button;
+        while ((button = button_poll()) != BUTTON_EVT_NONE) {
+            handle_button(button);
         }
         
-        _delay_ms(1);
-        ms_counter++;
+        command_t cmd;
+        if (command_poll(&cmd)) {
+            handle_command(&cmd);
+        }
         
-        if (!gate_moving) {
-            idle_timer_ms++;
+        uint8_t motion = motion_poll();
+        switch (motion) {
+            case MOTION_ARRIVED:
+                gate_dispatch(GATE_EV_ARRIVED);
+                break;
+            case MOTION_OBSTRUCTED:
+                gate_dispatch(GATE_EV_OBSTRUCTED);
+                break;
+            case MOTION_POWER_FAIL:
+                // No stats batch: the hold-up is spent on the journal record
+                gate_dispatch(GATE_EV_POWER_FAIL);
+                break;
         }
+        if (auto_close_due()) {
+            gate_dispatch(GATE_EV_AUTO_CLOSE);
+        }
+        gate_checkpoint();
+        stats_poll();
+
+        uart_poll();
+        boot_report_poll();
         
-        if (ms_counter >= 1000) {
-            ms_counter = 0;
-            
-            if (idle_timer_ms >= (REGULAR_RESET_HOURS * MS_PER_HOUR) && !gate_moving && !reset_scheduled) {
-                schedule_reset();
-            }
-            
-            if (reset_scheduled && idle_timer_ms >= RESET_DELAY) {
-                perform_controlled_reset();
-            }
+        uint8_t fault = health_poll();
+        if (fault == HEALTH_OK && gate_state >= GATE_STATES) {
+            fault = HEALTH_STATE;
+        }
+        if (fault != HEALTH_OK) {
+            health_fault(fault);
         }
+        
+        // Every event source is an interrupt, at the latest the next 1ms tick, or
+        // in power-save the next Timer2 compare once the gate has nothing to do
+        power_sleep(motion == MOTION_IDLE && !motion_busy() && boot_report_step > BOOT_REPORT_LAST);
     }
 }
@@ -0,0 +1,126 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "hall.h"
+#include "motion.h"
+#include "timer.h"
+
+#if HALL_SENSOR_ENABLE
+
+#define HALL_AVG_SHIFT 3             // Exponential average over ~8 periods
+
+static volatile bool hall_armed = false;
+static volatile bool hall_tripped = false;
+static volatile uint16_t hall_last_edge = 0;
+static volatile uint16_t hall_limit_us = HALL_MAX_PERIOD_US;
+static volatile uint16_t hall_avg_us = 0;
+static volatile uint8_t hall_edges = 0;
+
+static bool hall_running = false;
+static bool hall_learning = false;
+static uint32_t hall_start_ms = 0;
+
+static void hall_trip(void) {
+    motion_cut_relays();
+    hall_armed = false;
+    hall_tripped = true;
+    TIMSK &= ~(1 << OCIE1B);
+}
+
+void hall_init(void) {
+    DDRD &= ~(1 << HALL_PIN);
+    PORTD |= (1 << HALL_PIN);                  // Open-collector sensors need the pull-up
+    TCCR1B |= (1 << ICNC1) | (1 << ICES1);     // Noise canceller, rising edge
+}
+
+void hall_start(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        hall_armed = false;
+        hall_tripped = false;
+        hall_edges = 0;
+        hall_avg_us = 0;
+        hall_last_edge = TCNT1;
+        TIFR = (1 << ICF1) | (1 << OCF1B);
+        TIMSK |= (1 << TICIE1);
+    }
+    hall_running = true;
+    hall_learning = false;
+    hall_start_ms = millis();
+}
+
+void hall_stop(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        hall_armed = false;
+        TIMSK &= ~((1 << TICIE1) | (1 << OCIE1B));
+    }
+    hall_running = false;
+}
+
+// Polled while the motor runs; arms the limit once speed has been learned
+void hall_poll(void) {
+    if (!hall_running || hall_armed || hall_tripped) return;
+
+    if (!hall_learning) {
+        if (timer_elapsed(hall_start_ms, HALL_SPINUP_MS)) {
+            hall_learning = true;
+            hall_start_ms = millis();
+        }
+        return;
+    }
+
+    if (!timer_elapsed(hall_start_ms, HALL_LEARN_MS)) return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint32_t limit = hall_edges < 2 ? HALL_MAX_PERIOD_US :
+            ((uint32_t)hall_avg_us * HALL_SLOW_RATIO_Q4) >> 4;
+        hall_limit_us = limit > HALL_MAX_PERIOD_US ? HALL_MAX_PERIOD_US : limit;
+        OCR1B = hall_last_edge + hall_limit_us;
+        TIFR = (1 << OCF1B);
+        TIMSK |= (1 << OCIE1B);
+        hall_armed = true;
+    }
+
+    // The motor already stopped before we armed: no edge came within the limit
+    if ((uint16_t)(TCNT1 - hall_last_edge) > hall_limit_us) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            hall_trip();
+        }
+    }
+}
+
+bool hall_obstructed(void) {
+    return hall_tripped;
+}
+
+uint16_t hall_period_us(void) {
+    uint16_t period;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        period = hall_avg_us;
+    }
+    return period;
+}
+
+ISR(TIMER1_CAPT_vect) {
+    uint16_t edge = ICR1;
+    uint16_t period = edge - hall_last_edge;
+    hall_last_edge = edge;
+
+    if (hall_armed) {
+        OCR1B = edge + hall_limit_us;
+        if (period > hall_limit_us) hall_trip();
+    }
+
+    if (hall_edges < 2) {
+        hall_edges++;
+        hall_avg_us = period; // First period is measured from hall_start()
+    } else {
+        hall_avg_us += ((int16_t)(period - hall_avg_us)) >> HALL_AVG_SHIFT;
+    }
+}
+
+ISR(TIMER1_COMPB_vect) {
+    if (hall_armed) hall_trip();
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include <avr/io.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "health.h"
+#include "motion.h"
+#include "rtc.h"
+#include "timer.h"
+#include "uart.h"
+
+static uint32_t health_tick_seen = 0;
+static uint16_t health_idle_passes = 0;
+static uint32_t health_check_ms = 0;
+
+// Must run before interrupts are enabled, with main() the only frame on the stack
+void health_init(void) {
+    volatile uint8_t* p = hal_stack_floor();
+    volatile uint8_t* top = hal_stack_top();
+    while (p < top) *p++ = HEALTH_CANARY;
+}
+
+uint16_t health_stack_free(void) {
+    volatile const uint8_t* p = hal_stack_floor();
+    volatile const uint8_t* top = hal_stack_top();
+    uint16_t unused = 0;
+    while (p < top && *p++ == HEALTH_CANARY) unused++;
+    return unused;
+}
+
+// Each register compared with what its init function wrote
+static bool registers_ok(void) {
+    if (TCCR0 != TIMER0_CONTROL || OCR0 != (uint8_t)TIMER0_TOP || !(TIMSK & (1 << OCIE0))) return false;
+    if ((TCCR1B & TIMER1_CLOCK_MASK) != TIMER1_CLOCK) return false;
+#if RTC_ENABLE
+    if (!(ASSR & (1 << AS2)) || TCCR2 != RTC_TIMER2_CONTROL) return false;
+#endif
+    if ((UCSRB & UART_CONTROL) != UART_CONTROL || UBRRL != (uint8_t)UBRR_VALUE) return false;
+    if (!(GICR & (1 << INT0))) return false;
+    if ((DDRB & RELAY_MASK) != RELAY_MASK) return false;
+#if LEAF_B_ENABLE
+    if ((DDRC & RELAY_B_MASK) != RELAY_B_MASK) return false;
+#endif
+#if MOTOR_PWM_ENABLE
+    // Normal mode, whatever the output compare is doing
+    if (!(DDRD & (1 << PWM_PIN)) || (TCCR1A & ((1 << WGM11) | (1 << WGM10)))) return false;
+#endif
+    return true;
+}
+
+uint8_t health_poll(void) {
+    uint32_t now = millis();
+
+    if (now == health_tick_seen) {
+        // Only other interrupts have woken the loop since the last tick
+        if (++health_idle_passes > HEALTH_MAX_IDLE_PASSES) return HEALTH_TICK;
+        return HEALTH_OK;
+    }
+    health_tick_seen = now;
+    health_idle_passes = 0;
+
+    if (now - health_check_ms < HEALTH_CHECK_INTERVAL) return HEALTH_OK;
+    health_check_ms = now;
+
+    if (health_stack_free() < HEALTH_STACK_MARGIN) return HEALTH_STACK;
+    if (!registers_ok()) return HEALTH_REGISTERS;
+    if (uart_tx_stalled()) return HEALTH_UART;
+    return HEALTH_OK;
+}
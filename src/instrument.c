@@ -0,0 +1,160 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "button.h"
+#include "instrument.h"
+#include "motion.h"
+
+#if INSTRUMENT_ENABLE
+
+typedef struct {
+    uint16_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t sum;
+    uint8_t bins[INSTR_BINS];
+} instr_span_t;
+
+// log2 of the upper edge of bin 0, per span
+static const uint8_t instr_offset[INSTR_SPANS] PROGMEM = { 16, 11, 7 };
+
+static instr_span_t instr_spans[INSTR_SPANS];
+static volatile uint16_t instr_t1_high = 0;
+static volatile uint32_t instr_edge_us = 0;
+static volatile bool instr_edge_pending = false;
+static uint32_t instr_decision_us = 0;
+static bool instr_decision_pending = false;
+static uint32_t instr_loop_us = 0;
+static uint16_t instr_relays_seen = 0;
+
+static void instr_clear(void) {
+    for (uint8_t i = 0; i < INSTR_SPANS; i++) {
+        instr_span_t* s = &instr_spans[i];
+        s->count = 0;
+        s->min = UINT32_MAX;
+        s->max = 0;
+        s->sum = 0;
+        for (uint8_t b = 0; b < INSTR_BINS; b++) s->bins[b] = 0;
+    }
+}
+
+static void instr_halve(instr_span_t* s) {
+    s->count >>= 1;
+    s->sum >>= 1;
+    for (uint8_t b = 0; b < INSTR_BINS; b++) s->bins[b] >>= 1;
+}
+
+static void instr_record(uint8_t span, uint32_t us) {
+    instr_span_t* s = &instr_spans[span];
+
+    uint8_t bin = 0;
+    uint8_t offset = pgm_read_byte(&instr_offset[span]);
+    for (uint32_t v = us >> offset; v && bin < INSTR_BINS - 1; v >>= 1) bin++;
+
+    if (s->count == UINT16_MAX || s->bins[bin] == UINT8_MAX || s->sum > UINT32_MAX - us) {
+        instr_halve(s);
+    }
+    s->count++;
+    s->sum += us;
+    s->bins[bin]++;
+    if (us < s->min) s->min = us;
+    if (us > s->max) s->max = us;
+}
+
+// Microseconds since boot from Timer1, wraps after about 71 minutes
+static uint32_t instr_now(void) {
+    uint16_t high;
+    uint16_t low;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        high = instr_t1_high;
+        low = TCNT1;
+        // Overflow happened while interrupts were off and the ISR hasn't run yet
+        if ((TIFR & (1 << TOV1)) && low < 0x8000) high++;
+    }
+    return ((uint32_t)high << 16) | low;
+}
+
+void instrument_init(void) {
+    instr_clear();
+    instr_loop_us = instr_now();
+    TIFR = (1 << TOV1);
+    TIMSK |= (1 << TOIE1);
+}
+
+// Called from INT0_vect on the edge that starts a press
+void instrument_edge(void) {
+    instr_edge_us = instr_now();
+    instr_edge_pending = true;
+}
+
+void instrument_decision(bool from_button) {
+    uint32_t now = instr_now();
+
+    if (from_button) {
+        uint32_t edge_us;
+        bool pending;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            edge_us = instr_edge_us;
+            pending = instr_edge_pending;
+            instr_edge_pending = false;
+        }
+        if (pending) instr_record(INSTR_BUTTON, now - edge_us);
+    }
+
+    instr_decision_us = now;
+    instr_decision_pending = true;
+}
+
+// Called after every relay write; only a change answers a pending decision
+void instrument_relays(void) {
+    uint16_t relays = motion_relay_outputs();
+    if (relays == instr_relays_seen) return;
+    instr_relays_seen = relays;
+
+    if (instr_decision_pending) {
+        instr_record(INSTR_RELAY, instr_now() - instr_decision_us);
+        instr_decision_pending = false;
+    }
+}
+
+void instrument_loop(void) {
+    uint32_t now = instr_now();
+    instr_record(INSTR_LOOP, now - instr_loop_us);
+    instr_loop_us = now;
+}
+
+static void reply_le(uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        command_reply_byte((uint8_t)value);
+        value >>= 8;
+    }
+}
+
+void instrument_report(const command_t* cmd) {
+    if (command_reply_begin(cmd, INSTR_REPLY_SIZE)) {
+        for (uint8_t i = 0; i < INSTR_SPANS; i++) {
+            const instr_span_t* s = &instr_spans[i];
+            reply_le(s->count, 2);
+            reply_le(s->count ? s->min : 0, 4);
+            reply_le(s->max, 4);
+            reply_le(s->count ? s->sum / s->count : 0, 4);
+            for (uint8_t b = 0; b < INSTR_BINS; b++) command_reply_byte(s->bins[b]);
+        }
+        command_reply_byte(button_dropped());
+        command_reply_byte(button_max_wait_ms());
+        command_reply_end();
+    }
+
+    if (cmd->len > 0 && cmd->payload[0] == 1) {
+        instr_clear();
+        button_clear_stats();
+    }
+}
+
+ISR(TIMER1_OVF_vect) {
+    instr_t1_high++;
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <util/crc16.h>
+
+#include "eeprom_queue.h"
+#include "journal.h"
+
+#define JOURNAL_CRC_SEED 0x5A
+
+typedef struct {
+    uint8_t seq;
+    uint8_t state;
+    uint8_t flags;
+    uint8_t check;
+} journal_record_t;
+
+static journal_record_t journal_head;
+static uint8_t journal_slot = JOURNAL_SLOTS - 1;
+static bool journal_valid = false;
+
+static uint8_t journal_crc(const journal_record_t* rec) {
+    uint8_t crc = JOURNAL_CRC_SEED;
+    crc = _crc8_ccitt_update(crc, rec->seq);
+    crc = _crc8_ccitt_update(crc, rec->state);
+    crc = _crc8_ccitt_update(crc, rec->flags);
+    return crc;
+}
+
+static uint16_t slot_addr(uint8_t slot) {
+    return EE_JOURNAL_START + (uint16_t)slot * JOURNAL_RECORD_SIZE;
+}
+
+void journal_init(void) {
+    journal_record_t rec;
+
+    journal_valid = false;
+    for (uint8_t slot = 0; slot < JOURNAL_SLOTS; slot++) {
+        ee_queue_read_block(&rec, slot_addr(slot), sizeof(rec));
+        if (rec.check != journal_crc(&rec)) continue;
+
+        // All live sequence numbers sit within one window, so the signed
+        // difference orders them across the 8-bit wrap
+        if (!journal_valid || (int8_t)(rec.seq - journal_head.seq) > 0) {
+            journal_head = rec;
+            journal_slot = slot;
+            journal_valid = true;
+        }
+    }
+}
+
+uint8_t journal_state(void) {
+    return journal_valid ? journal_head.state : JOURNAL_EMPTY;
+}
+
+uint8_t journal_flags(void) {
+    return journal_valid ? journal_head.flags : 0;
+}
+
+void journal_write(uint8_t state, uint8_t flags) {
+    if (journal_valid && journal_head.state == state && journal_head.flags == flags) {
+        return;
+    }
+
+    journal_slot = (journal_slot + 1) % JOURNAL_SLOTS;
+    journal_head.seq = journal_valid ? journal_head.seq + 1 : 0;
+    journal_head.state = state;
+    journal_head.flags = flags;
+    journal_head.check = journal_crc(&journal_head);
+    journal_valid = true;
+
+    // The CRC goes last so an interrupted write never produces a valid record
+    uint16_t addr = slot_addr(journal_slot);
+    ee_queue_write(addr + 0, journal_head.seq);
+    ee_queue_write(addr + 1, journal_head.state);
+    ee_queue_write(addr + 2, journal_head.flags);
+    ee_queue_write(addr + 3, journal_head.check);
+}
@@ -0,0 +1,435 @@
+#include <avr/io.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+#include "current_sense.h"
+#include "hall.h"
+#include "instrument.h"
+#include "motion.h"
+#include "pwm.h"
+#include "stats.h"
+#include "supply.h"
+#include "timer.h"
+#include "travel.h"
+
+#if LEAF_B_ENABLE && (LEAF_OPEN_STAGGER_MS < CURRENT_INRUSH_MS || LEAF_CLOSE_STAGGER_MS < CURRENT_INRUSH_MS)
+#error "Leaf stagger must outlast the motor inrush (CURRENT_INRUSH_MS)"
+#endif
+
+#if MOTOR_PWM_ENABLE && CURRENT_SENSE_ENABLE && MOTOR_RELAY_SETTLE_MS + MOTOR_RAMP_UP_MS > CURRENT_INRUSH_MS
+#error "The soft start must be over before current sensing learns the running current"
+#endif
+
+#if MOTOR_PWM_ENABLE && HALL_SENSOR_ENABLE && MOTOR_RELAY_SETTLE_MS + MOTOR_RAMP_UP_MS > HALL_SPINUP_MS
+#error "The soft start must be over before the hall sensor learns the motor speed"
+#endif
+
+typedef struct {
+    uint8_t state;
+    uint8_t direction;
+    bool completed;
+    uint16_t wait_ms;                // Dead time, plus the stagger for the following leaf
+    uint32_t phase_ms;
+    uint32_t run_ms;
+} motion_leaf_t;
+
+static motion_leaf_t leaves[MOTION_LEAVES];
+static bool motion_endstop = false;
+
+#if RELAY_ECONOMY_ENABLE
+volatile uint8_t motion_relays_held[MOTION_LEAVES];
+static uint8_t relay_pull_in[MOTION_LEAVES];
+static uint8_t relay_phase = 0;
+#endif
+
+#if MOTOR_PWM_ENABLE
+static bool soft_stopping = false;
+static uint32_t soft_stop_ms;
+static uint8_t soft_stop_duty;       // Duty the ramp-down starts from, 0 once the MOSFET is off
+#endif
+
+// Leaf A's bridge is on PORTB, leaf B's on PORTC
+static inline void coils_on(uint8_t leaf, uint8_t coils) {
+#if LEAF_B_ENABLE
+    if (leaf == LEAF_B) {
+        PORTC |= coils;
+        return;
+    }
+#endif
+    PORTB |= coils;
+}
+
+static inline void coils_off(uint8_t leaf, uint8_t coils) {
+#if LEAF_B_ENABLE
+    if (leaf == LEAF_B) {
+        PORTC &= ~coils;
+        return;
+    }
+#endif
+    PORTB &= ~coils;
+}
+
+static bool any_leaf(uint8_t state) {
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        if (leaves[i].state == state) return true;
+    }
+    return false;
+}
+
+static void relays_off(uint8_t leaf) {
+    if (leaf == LEAF_A) {
+        current_sense_stop();
+        hall_stop();
+    }
+#if RELAY_ECONOMY_ENABLE
+    motion_relays_held[leaf] = 0;
+#endif
+    coils_off(leaf, leaf == LEAF_A ? RELAY_MASK : RELAY_B_MASK);
+    instrument_relays();
+    if (!any_leaf(MOTION_RUNNING)) {
+        supply_stop();
+        PORTD &= ~LED_MASK;
+    }
+}
+
+static void relays_all_off(void) {
+    current_sense_stop();
+    hall_stop();
+    supply_stop();
+    motion_cut_relays();
+#if MOTOR_PWM_ENABLE
+    soft_stopping = false;
+#endif
+    instrument_relays();
+    PORTD &= ~LED_MASK;
+}
+
+static void relays_drive(uint8_t leaf, uint8_t direction) {
+    uint8_t coils;
+    if (direction == MOTION_DIR_OPEN) {
+        coils = leaf == LEAF_A ? (1 << RELAY_K1) | (1 << RELAY_K4) : (1 << RELAY_B_K1) | (1 << RELAY_B_K4);
+        PORTD |= (1 << LED_OPENING);
+        PORTD &= ~(1 << LED_CLOSING);
+    } else {
+        coils = leaf == LEAF_A ? (1 << RELAY_K2) | (1 << RELAY_K3) : (1 << RELAY_B_K2) | (1 << RELAY_B_K3);
+        PORTD |= (1 << LED_CLOSING);
+        PORTD &= ~(1 << LED_OPENING);
+    }
+    coils_on(leaf, coils);
+    stats_actuation(leaf, direction);
+    supply_start();
+#if RELAY_ECONOMY_ENABLE
+    // The tick ISR leaves the port alone until the held mask is set
+    relay_pull_in[leaf] = RELAY_PULL_IN_TIME;
+    relay_phase = 0;
+    motion_relays_held[leaf] = coils;
+#endif
+    instrument_relays();
+}
+
+#if RELAY_ECONOMY_ENABLE
+// Called from the system tick ISR
+void motion_tick(void) {
+    if (++relay_phase >= RELAY_HOLD_PERIOD) relay_phase = 0;
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        uint8_t coils = motion_relays_held[i];
+        if (!coils) continue;
+
+        if (relay_pull_in[i]) {
+            relay_pull_in[i]--;
+        } else if (relay_phase < RELAY_HOLD_ON) {
+            coils_on(i, coils);
+        } else {
+            coils_off(i, coils);
+        }
+    }
+}
+#endif
+
+// Atomic for motion_position(), which the supply monitor calls from ADC_vect
+static void enter(motion_leaf_t* leaf, uint8_t state) {
+    uint32_t now = millis();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        leaf->state = state;
+        leaf->phase_ms = now;
+    }
+}
+
+#if MOTOR_PWM_ENABLE
+// The relays closed `elapsed_ms` ago with the MOSFET off
+static void soft_start(uint32_t elapsed_ms) {
+    if (elapsed_ms < MOTOR_RELAY_SETTLE_MS) return;
+
+    uint8_t duty = pwm_ramp(MOTOR_RAMP_START_DUTY, PWM_FULL, elapsed_ms - MOTOR_RELAY_SETTLE_MS, MOTOR_RAMP_UP_MS);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // Never turn the MOSFET back on behind an interrupt that cut the relays
+        if (motion_relay_outputs()) pwm_set(duty);
+    }
+}
+
+// Ramps the MOSFET down from `duty`, or cuts it at once below the start duty
+static void soft_stop(uint8_t duty) {
+    current_sense_stop();
+    hall_stop();
+    if (duty <= MOTOR_RAMP_START_DUTY) {
+        pwm_cut();
+        duty = 0;
+    }
+    soft_stop_duty = duty;
+    soft_stop_ms = millis();
+    soft_stopping = true;
+}
+
+// True while a soft stop holds `leaf` up; its phase starts again once the relays are open
+static bool soft_stop_poll(motion_leaf_t* leaf) {
+    if (!soft_stopping) return false;
+
+    uint32_t elapsed_ms = millis() - soft_stop_ms;
+    if (soft_stop_duty) {
+        if (elapsed_ms < MOTOR_RAMP_DOWN_MS) {
+            pwm_set(pwm_ramp(soft_stop_duty, MOTOR_RAMP_START_DUTY, elapsed_ms, MOTOR_RAMP_DOWN_MS));
+        } else {
+            pwm_cut();
+            soft_stop_duty = 0;
+            soft_stop_ms = millis();
+        }
+        return true;
+    }
+    if (elapsed_ms < MOTOR_CURRENT_DECAY_MS) return true;
+
+    soft_stopping = false;
+    relays_off(LEAF_A);
+    enter(leaf, leaf->state);
+    return false;
+}
+#else
+static inline bool soft_stop_poll(motion_leaf_t* leaf) { return false; }
+#endif
+
+// Every relay off; in PWM builds a running motor is ramped down first
+static void release(void) {
+#if MOTOR_PWM_ENABLE
+    if (leaves[LEAF_A].state == MOTION_RUNNING) {
+        soft_stop(pwm_duty());
+        return;
+    }
+    if (soft_stopping) return;
+#endif
+    relays_all_off();
+}
+
+void motion_init(void) {
+    pwm_init();
+    relays_all_off();
+    DDRB |= RELAY_MASK;
+#if LEAF_B_ENABLE
+    DDRC |= RELAY_B_MASK;
+#endif
+    DDRD |= LED_MASK;
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        leaves[i].state = MOTION_IDLE;
+    }
+}
+
+// A run cut short still moved the gate; only leaf A's runs count
+static void note_travel(void) {
+    motion_leaf_t* leaf = &leaves[LEAF_A];
+    if (leaf->state == MOTION_RUNNING) {
+        uint32_t ran_ms = millis() - leaf->phase_ms;
+        travel_moved(leaf->direction, ran_ms, false);
+        stats_run(leaf->direction, ran_ms);
+    }
+}
+
+void motion_start(uint8_t direction, uint32_t run_ms) {
+    note_travel();
+    release();
+    supply_forget();
+    motion_endstop = false;
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        motion_leaf_t* leaf = &leaves[i];
+        bool follows = (i == LEAF_B) == (direction == MOTION_DIR_OPEN);
+
+        leaf->direction = direction;
+        leaf->run_ms = run_ms;
+        leaf->completed = false;
+        leaf->wait_ms = RELAY_SWITCHING_DELAY;
+        if (MOTION_LEAVES > 1 && follows) {
+            leaf->wait_ms += direction == MOTION_DIR_OPEN ? LEAF_OPEN_STAGGER_MS : LEAF_CLOSE_STAGGER_MS;
+        }
+        enter(leaf, MOTION_DEAD_TIME);
+    }
+}
+
+void motion_stop(void) {
+    if (any_leaf(MOTION_RUNNING)) stats_stop();
+    note_travel();
+    release();
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        motion_leaf_t* leaf = &leaves[i];
+        leaf->completed = false;
+        if (leaf->state != MOTION_IDLE) {
+            enter(leaf, MOTION_BRAKING);
+        }
+    }
+}
+
+static void leaf_finish(uint8_t index) {
+    enter(&leaves[index], MOTION_BRAKING);
+#if MOTOR_PWM_ENABLE
+    // A stalled motor isn't turning, so there is nothing to ramp down
+    soft_stop(motion_endstop ? 0 : pwm_duty());
+#else
+    relays_off(index);
+#endif
+    leaves[index].completed = true;
+}
+
+static uint8_t leaf_poll(uint8_t index) {
+    motion_leaf_t* leaf = &leaves[index];
+
+    switch (leaf->state) {
+        case MOTION_DEAD_TIME:
+            if (soft_stop_poll(leaf)) break;
+            if (timer_elapsed(leaf->phase_ms, leaf->wait_ms)) {
+                relays_drive(index, leaf->direction);
+                if (index == LEAF_A) {
+                    current_sense_start();
+                    hall_start();
+                }
+                enter(leaf, MOTION_RUNNING);
+            }
+            break;
+        case MOTION_RUNNING: {
+            bool endstop = false;
+            if (index == LEAF_A) {
+                hall_poll();
+                bool hall_stop = hall_obstructed();
+                if (hall_stop || current_sense_stalled()) {
+                    uint32_t ran_ms = millis() - leaf->phase_ms;
+                    if (!travel_at_end(leaf->direction, ran_ms)) {
+                        // Stopped short of the end of travel: something is in the way
+                        travel_moved(leaf->direction, ran_ms, false);
+                        stats_run(leaf->direction, ran_ms);
+                        stats_stall();
+                        return MOTION_OBSTRUCTED;
+                    }
+                    // The motor stopped where the endstop should be
+                    endstop = true;
+#if LEAF_B_ENABLE
+                    // The hall ISR cut leaf B's relays as well, its run is over
+                    if (hall_stop && leaves[LEAF_B].state == MOTION_RUNNING) leaf_finish(LEAF_B);
+#endif
+                }
+                motion_endstop = endstop;
+            }
+            if (endstop || timer_elapsed(leaf->phase_ms, leaf->run_ms)) {
+                if (index == LEAF_A) {
+                    uint32_t ran_ms = millis() - leaf->phase_ms;
+                    travel_moved(leaf->direction, ran_ms, endstop);
+                    stats_run(leaf->direction, ran_ms);
+#if CURRENT_SENSE_ENABLE || HALL_SENSOR_ENABLE
+                    if (!endstop) travel_timed_out(leaf->direction);
+#endif
+                }
+                leaf_finish(index);
+                break;
+            }
+#if MOTOR_PWM_ENABLE
+            soft_start(millis() - leaf->phase_ms);
+#endif
+            break;
+        }
+        case MOTION_BRAKING:
+            if (soft_stop_poll(leaf)) break;
+            if (timer_elapsed(leaf->phase_ms, RELAY_SWITCHING_DELAY)) {
+                // A completed leaf waits in ARRIVED for the others
+                enter(leaf, leaf->completed ? MOTION_ARRIVED : MOTION_IDLE);
+            }
+            break;
+    }
+    return leaf->state;
+}
+
+// Finish every leaf without arriving, after an interrupt cut every relay or
+// a stall that still drives them
+static void motion_halt(void) {
+#if MOTOR_PWM_ENABLE
+    // As at an endstop, the contacts only open once the stalled current has decayed
+    if (motion_relay_outputs()) {
+        soft_stop(0);
+    } else {
+        relays_all_off();
+    }
+#else
+    relays_all_off();
+#endif
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        leaves[i].completed = false;
+        enter(&leaves[i], MOTION_BRAKING);
+    }
+}
+
+uint8_t motion_poll(void) {
+    uint8_t state = MOTION_IDLE;
+    bool arrived = false;
+
+    if (supply_sagged()) {
+        note_travel();
+        motion_halt();
+        return MOTION_POWER_FAIL;
+    }
+
+    for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+        uint8_t leaf_state = leaf_poll(i);
+        if (leaf_state == MOTION_OBSTRUCTED) {
+            // A hall trip already cut every relay, a stall still drives them; halt every leaf
+            motion_halt();
+            return MOTION_OBSTRUCTED;
+        }
+        if (leaf_state == MOTION_ARRIVED) {
+            arrived = true;
+        } else if (leaf_state != MOTION_IDLE && state == MOTION_IDLE) {
+            state = leaf_state;
+        }
+    }
+
+    // Reported to the caller exactly once, by the pass the last leaf finished
+    if (state == MOTION_IDLE && arrived) {
+        for (uint8_t i = 0; i < MOTION_LEAVES; i++) {
+            leaves[i].state = MOTION_IDLE;
+        }
+        return MOTION_ARRIVED;
+    }
+    return state;
+}
+
+// True if the last completed run was ended by the motor stalling at its endstop
+bool motion_at_endstop(void) {
+    return motion_endstop;
+}
+
+// Leaf A's estimated position right now; safe to call from interrupt context
+uint16_t motion_position(void) {
+    motion_leaf_t* leaf = &leaves[LEAF_A];
+    uint8_t state;
+    uint32_t phase_ms;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        state = leaf->state;
+        phase_ms = leaf->phase_ms;
+    }
+    if (state != MOTION_RUNNING) return travel_position();
+    return travel_position_after(leaf->direction, millis() - phase_ms);
+}
+
+// Direction of the current or last run
+uint8_t motion_direction(void) {
+    return leaves[LEAF_A].direction;
+}
+
+uint8_t motion_busy(void) {
+    return any_leaf(MOTION_DEAD_TIME) || any_leaf(MOTION_RUNNING);
+}
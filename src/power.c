@@ -0,0 +1,104 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "button.h"
+#include "command.h"
+#include "eeprom_queue.h"
+#include "power.h"
+#include "rtc.h"
+#include "timer.h"
+#include "uart.h"
+
+#if POWER_SAVE_ENABLE
+
+static volatile bool power_asleep = false;
+static uint8_t power_t2_start;       // TCNT2 when the chip went to sleep
+static uint8_t power_t2_fraction;    // Left over from the last catch-up, in 1/RTC_HZ ms
+static uint32_t power_active_ms;
+
+void power_init(void) {
+    DDRD &= ~(1 << POWER_RX_WAKE_PIN);
+    PORTD |= (1 << POWER_RX_WAKE_PIN);
+    power_active_ms = millis();
+}
+
+void power_activity(void) {
+    power_active_ms = millis();
+}
+
+static bool power_quiet(void) {
+    return timer_elapsed(power_active_ms, POWER_AWAKE_MS) && uart_tx_done() && ee_queue_idle() &&
+        button_idle() && command_idle();
+}
+
+// Enters power-save with interrupts off, returns once awake and caught up
+static void power_save(void) {
+    TIFR = (1 << OCF2);
+    TIMSK |= (1 << OCIE2);
+    // Only a low level wakes the chip without a clock
+    MCUCR &= ~((1 << ISC11) | (1 << ISC10) | (1 << ISC01) | (1 << ISC00));
+    GIFR = (1 << INTF1);
+    GICR |= (1 << INT1);
+    power_asleep = true;
+
+    set_sleep_mode(SLEEP_MODE_PWR_SAVE);
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        power_wake();
+    }
+}
+
+// Replaces sleep_mode() at the end of the main loop; `quiet` if the gate and the boot report are done
+void power_sleep(bool quiet) {
+    if (quiet && power_quiet()) {
+        power_t2_start = TCNT2;
+        OCR2 = power_t2_start + POWER_SLEEP_COUNTS;
+        // Also the crystal cycle power-save needs after a Timer2 wake-up
+        rtc_settle();
+
+        cli();
+        if (power_quiet()) {
+            power_save();
+            return;
+        }
+        sei();
+    }
+    sleep_mode();
+}
+
+// Called by whatever runs first after a wake-up, with interrupts off
+void power_wake(void) {
+    if (!power_asleep) return;
+    power_asleep = false;
+
+    GICR &= ~(1 << INT1);
+    TIMSK &= ~(1 << OCIE2);
+    MCUCR |= (1 << ISC00);                     // INT0 back to any logical change
+
+    // TCNT2 reads as before the sleep until the next crystal edge; a write waits for one
+    TCCR2 = RTC_TIMER2_CONTROL;
+    rtc_settle();
+
+    uint32_t scaled = (uint32_t)(uint8_t)(TCNT2 - power_t2_start) * 1000 + power_t2_fraction;
+    power_t2_fraction = scaled % RTC_HZ;
+    timer_advance(scaled / RTC_HZ);
+}
+
+// A byte on RXD, likely a host's wake-up byte; stay up for the frame after it
+ISR(INT1_vect) {
+    power_wake();
+    power_active_ms = millis();
+}
+
+// Only there to wake the chip; power_wake() disables it again
+ISR(TIMER2_COMP_vect) {
+}
+
+#endif
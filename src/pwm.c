@@ -0,0 +1,87 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+#include "pwm.h"
+
+#if MOTOR_PWM_ENABLE
+
+#define PWM_RISE ((1 << COM1A1) | (1 << COM1A0))   // Set OC1A at the next match
+#define PWM_FALL (1 << COM1A1)                      // Clear OC1A at the next match
+
+static volatile uint16_t pwm_on_us;
+static uint16_t pwm_edge;            // Timer1 count of the latest rising edge
+static uint8_t pwm_level = 0;
+
+void pwm_init(void) {
+    pwm_cut();
+    DDRD |= (1 << PWM_PIN);
+}
+
+void pwm_set(uint8_t duty) {
+    uint16_t on_us = (uint32_t)duty * MOTOR_PWM_PERIOD_US / PWM_FULL;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (on_us < MOTOR_PWM_MIN_US) {
+            pwm_cut();
+        } else if (on_us > MOTOR_PWM_PERIOD_US - MOTOR_PWM_MIN_US) {
+            PORTD |= (1 << PWM_PIN);
+            TCCR1A = 0;
+            TIMSK &= ~(1 << OCIE1A);
+        } else {
+            pwm_on_us = on_us;
+            if (!(TIMSK & (1 << OCIE1A))) {
+                // Start a period with a rising edge right now
+                TCCR1A = PWM_RISE | (1 << FOC1A);
+                pwm_edge = TCNT1;
+                TCCR1A = PWM_FALL;
+                OCR1A = pwm_edge + on_us;
+                TIFR = (1 << OCF1A);
+                TIMSK |= (1 << OCIE1A);
+            }
+        }
+    }
+    pwm_level = duty;
+}
+
+// Duty the MOSFET is driven at now, 0 after an interrupt cut it
+uint8_t pwm_duty(void) {
+    if (TIMSK & (1 << OCIE1A)) return pwm_level;
+    return PORTD & (1 << PWM_PIN) ? PWM_FULL : 0;
+}
+
+// Duty `elapsed_ms` into a ramp from `from` to `to`, shaped by MOTOR_RAMP_PROFILE
+uint8_t pwm_ramp(uint8_t from, uint8_t to, uint32_t elapsed_ms, uint16_t ramp_ms) {
+    if (elapsed_ms >= ramp_ms) return to;
+
+    uint32_t x = elapsed_ms * 256 / ramp_ms;       // Progress, Q8
+#if MOTOR_RAMP_PROFILE == MOTOR_RAMP_S_CURVE
+    x = x * x * (3 * 256 - 2 * x) >> 16;           // 3x^2 - 2x^3
+#endif
+    return from + (((int32_t)to - from) * (int32_t)x >> 8);
+}
+
+// Schedules the edge after the one that just happened
+ISR(TIMER1_COMPA_vect) {
+    bool rose = TCCR1A & (1 << COM1A0);
+
+    for (;;) {
+        if (rose) {
+            TCCR1A = PWM_FALL;
+            OCR1A = pwm_edge + pwm_on_us;
+        } else {
+            pwm_edge += MOTOR_PWM_PERIOD_US;
+            TCCR1A = PWM_RISE;
+            OCR1A = pwm_edge;
+        }
+        if ((int16_t)(OCR1A - TCNT1) > 0) break;
+
+        // Held up past the next edge: make it now
+        TCCR1A |= (1 << FOC1A);
+        TIFR = (1 << OCF1A);
+        rose = !rose;
+    }
+}
+
+#endif
@@ -0,0 +1,21 @@
+#include <avr/io.h>
+
+#include "hal.h"
+#include "rtc.h"
+
+#if RTC_ENABLE
+
+void rtc_init(void) {
+    TIMSK &= ~((1 << OCIE2) | (1 << TOIE2));
+    ASSR |= (1 << AS2);
+    TCNT2 = 0;
+    TCCR2 = RTC_TIMER2_CONTROL;
+    rtc_settle();
+    TIFR = (1 << OCF2) | (1 << TOV2);
+}
+
+void rtc_settle(void) {
+    while (ASSR & ((1 << TCN2UB) | (1 << OCR2UB) | (1 << TCR2UB))) hal_spin();
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdbool.h>
+#include <string.h>
+#include <util/crc16.h>
+
+#include "eeprom_queue.h"
+#include "motion.h"
+#include "stats.h"
+#include "timer.h"
+
+#define STATS_CRC_SEED 0x96
+#define STATS_COUNT_MAX 0xFFFFFFUL   // Largest count a 24-bit field holds
+
+typedef struct {
+    uint32_t actuations[STATS_LEAVES][2];
+    uint32_t run_s[2];
+    uint16_t stops;
+    uint16_t stalls;
+} stats_t;
+
+static stats_t stats;
+static uint16_t stats_run_ms[2];     // Part of a second not counted yet
+static uint8_t stats_seq = 0;
+static uint8_t stats_copy = 0;       // Holds the newest batch
+static bool stats_dirty = false;
+static uint32_t stats_changed_ms;
+
+static uint16_t copy_addr(uint8_t copy) {
+    return EE_STATS_START + (uint16_t)copy * STATS_RECORD_SIZE;
+}
+
+static uint8_t record_crc(const uint8_t* rec) {
+    uint8_t crc = STATS_CRC_SEED;
+    for (uint8_t i = 0; i < STATS_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, rec[i]);
+    }
+    return crc;
+}
+
+static uint8_t* put_le(uint8_t* p, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        *p++ = (uint8_t)value;
+        value >>= 8;
+    }
+    return p;
+}
+
+static const uint8_t* get_le(const uint8_t* p, uint32_t* value, uint8_t bytes) {
+    *value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        *value |= (uint32_t)*p++ << (8 * i);
+    }
+    return p;
+}
+
+// Byte 0 is the sequence number and the last one the CRC
+static void pack(uint8_t* rec) {
+    uint8_t* p = rec + 1;
+    for (uint8_t leaf = 0; leaf < STATS_LEAVES; leaf++) {
+        p = put_le(p, stats.actuations[leaf][MOTION_DIR_OPEN], 3);
+        p = put_le(p, stats.actuations[leaf][MOTION_DIR_CLOSE], 3);
+    }
+    p = put_le(p, stats.run_s[MOTION_DIR_OPEN], 3);
+    p = put_le(p, stats.run_s[MOTION_DIR_CLOSE], 3);
+    p = put_le(p, stats.stops, 2);
+    put_le(p, stats.stalls, 2);
+}
+
+static void unpack(const uint8_t* rec) {
+    const uint8_t* p = rec + 1;
+    uint32_t value;
+    for (uint8_t leaf = 0; leaf < STATS_LEAVES; leaf++) {
+        p = get_le(p, &stats.actuations[leaf][MOTION_DIR_OPEN], 3);
+        p = get_le(p, &stats.actuations[leaf][MOTION_DIR_CLOSE], 3);
+    }
+    p = get_le(p, &stats.run_s[MOTION_DIR_OPEN], 3);
+    p = get_le(p, &stats.run_s[MOTION_DIR_CLOSE], 3);
+    p = get_le(p, &value, 2);
+    stats.stops = value;
+    get_le(p, &value, 2);
+    stats.stalls = value;
+}
+
+static void changed(void) {
+    stats_dirty = true;
+    stats_changed_ms = millis();
+}
+
+static void count(uint32_t* counter) {
+    if (*counter < STATS_COUNT_MAX) (*counter)++;
+    changed();
+}
+
+static void count16(uint16_t* counter) {
+    if (*counter < UINT16_MAX) (*counter)++;
+    changed();
+}
+
+void stats_init(void) {
+    uint8_t rec[STATS_RECORD_SIZE];
+    bool found = false;
+
+    for (uint8_t copy = 0; copy < STATS_COPIES; copy++) {
+        ee_queue_read_block(rec, copy_addr(copy), sizeof(rec));
+        if (rec[STATS_RECORD_SIZE - 1] != record_crc(rec)) continue;
+
+        if (!found || (int8_t)(rec[0] - stats_seq) > 0) {
+            stats_seq = rec[0];
+            stats_copy = copy;
+            unpack(rec);
+            found = true;
+        }
+    }
+}
+
+void stats_actuation(uint8_t leaf, uint8_t direction) {
+    count(&stats.actuations[leaf][direction]);
+}
+
+void stats_run(uint8_t direction, uint32_t run_ms) {
+    run_ms += stats_run_ms[direction];
+    stats_run_ms[direction] = run_ms % 1000;
+
+    uint32_t run_s = stats.run_s[direction] + run_ms / 1000;
+    stats.run_s[direction] = run_s > STATS_COUNT_MAX ? STATS_COUNT_MAX : run_s;
+    changed();
+}
+
+void stats_stop(void) {
+    count16(&stats.stops);
+}
+
+void stats_stall(void) {
+    count16(&stats.stalls);
+}
+
+// Writes a batch once the gate has rested for STATS_FLUSH_IDLE_MS
+void stats_poll(void) {
+    if (stats_dirty && !motion_busy() && timer_elapsed(stats_changed_ms, STATS_FLUSH_IDLE_MS)) {
+        stats_flush();
+    }
+}
+
+void stats_flush(void) {
+    if (!stats_dirty) return;
+    stats_dirty = false;
+
+    uint8_t rec[STATS_RECORD_SIZE];
+    stats_copy = (stats_copy + 1) % STATS_COPIES;
+    rec[0] = ++stats_seq;
+    pack(rec);
+    rec[STATS_RECORD_SIZE - 1] = record_crc(rec);
+
+    // The CRC goes last, so a torn batch never replaces the previous one
+    uint16_t addr = copy_addr(stats_copy);
+    for (uint8_t i = 0; i < STATS_RECORD_SIZE; i++) {
+        ee_queue_write(addr + i, rec[i]);
+    }
+}
+
+static void reply_le(uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        command_reply_byte((uint8_t)value);
+        value >>= 8;
+    }
+}
+
+void stats_report(const command_t* cmd) {
+    if (command_reply_begin(cmd, STATS_REPLY_SIZE)) {
+        for (uint8_t leaf = 0; leaf < STATS_LEAVES; leaf++) {
+            reply_le(stats.actuations[leaf][MOTION_DIR_OPEN], 4);
+            reply_le(stats.actuations[leaf][MOTION_DIR_CLOSE], 4);
+        }
+        reply_le(stats.run_s[MOTION_DIR_OPEN], 4);
+        reply_le(stats.run_s[MOTION_DIR_CLOSE], 4);
+        reply_le(stats.stops, 2);
+        reply_le(stats.stalls, 2);
+        command_reply_end();
+    }
+
+    if (cmd->len > 0 && cmd->payload[0] == 1) {
+        memset(&stats, 0, sizeof(stats));
+        memset(stats_run_ms, 0, sizeof(stats_run_ms));
+        changed();
+        stats_flush();
+    }
+}
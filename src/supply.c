@@ -0,0 +1,80 @@
+#include "adc.h"
+#include "eeprom_layout.h"
+#include "eeprom_queue.h"
+#include "motion.h"
+#include "supply.h"
+#include "travel.h"
+
+#if SUPPLY_MONITOR_ENABLE
+
+static volatile uint8_t supply_record = SUPPLY_RECORD_NONE;    // Mirrors the EEPROM byte
+static volatile bool supply_low = false;
+static uint8_t supply_low_count = 0;
+
+// Also false for SUPPLY_RECORD_NONE
+static bool supply_valid(uint8_t record) {
+    return (record & ~SUPPLY_RECORD_OPENING) <= SUPPLY_RECORD_STEPS;
+}
+
+void supply_init(void) {
+    supply_record = ee_queue_read(EE_POWER_FAIL_START);
+}
+
+void supply_start(void) {
+    supply_low_count = 0;
+    adc_start(SUPPLY_CHANNEL);
+}
+
+void supply_stop(void) {
+    adc_stop(SUPPLY_CHANNEL);
+}
+
+// The gate is about to move, so a saved position no longer describes it
+void supply_forget(void) {
+    if (supply_record == SUPPLY_RECORD_NONE || supply_low) return;
+
+    supply_record = SUPPLY_RECORD_NONE;
+    // Through the same slot as the record, so a sag's record always lands last
+    ee_queue_urgent(EE_POWER_FAIL_START, SUPPLY_RECORD_NONE);
+}
+
+// True once after the monitor cut the relays
+bool supply_sagged(void) {
+    if (!supply_low) return false;
+    supply_low = false;
+    return true;
+}
+
+// The run a brown-out cut short, read once on boot
+bool supply_recover(uint8_t* direction, uint16_t* position) {
+    uint8_t record = supply_record;
+    if (!supply_valid(record)) return false;
+
+    *direction = record & SUPPLY_RECORD_OPENING ? MOTION_DIR_OPEN : MOTION_DIR_CLOSE;
+    *position = (uint32_t)(record & ~SUPPLY_RECORD_OPENING) * TRAVEL_POS_OPEN / SUPPLY_RECORD_STEPS;
+    return true;
+}
+
+// Called from ADC_vect with every conversion of the divider channel
+void supply_sample(uint16_t value) {
+    if (value >= SUPPLY_SAG_COUNTS) {
+        supply_low_count = 0;
+        return;
+    }
+    if (++supply_low_count < SUPPLY_SAG_CONFIRM) return;
+
+    motion_cut_relays();
+    adc_stop(SUPPLY_CHANNEL);
+
+    uint8_t record = (uint32_t)(motion_position() + TRAVEL_POS_OPEN / SUPPLY_RECORD_STEPS / 2) *
+        SUPPLY_RECORD_STEPS / TRAVEL_POS_OPEN;
+    if (motion_direction() == MOTION_DIR_OPEN) record |= SUPPLY_RECORD_OPENING;
+
+    // Ahead of the queue: it can hold a quarter second of writes and the
+    // supply has milliseconds
+    ee_queue_urgent(EE_POWER_FAIL_START, record);
+    supply_record = record;
+    supply_low = true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#include "telemetry.h"
+#include "timer.h"
+
+#if TELEMETRY_BINARY
+
+#define TELEMETRY_MASK (TELEMETRY_QUEUE_SIZE - 1)
+
+#if TELEMETRY_QUEUE_SIZE & TELEMETRY_MASK
+#error "TELEMETRY_QUEUE_SIZE must be a power of two"
+#endif
+
+typedef struct {
+    uint8_t id_state;
+    uint16_t seconds;
+} telemetry_rec_t;
+
+static telemetry_rec_t telemetry_queue[TELEMETRY_QUEUE_SIZE];
+static uint8_t telemetry_head = 0;
+static uint8_t telemetry_count = 0;
+static uint8_t telemetry_lost = 0;
+
+// Foreground only; the oldest record is overwritten when the ring is full
+void telemetry_record(uint8_t evt, uint8_t state) {
+    telemetry_rec_t* rec = &telemetry_queue[telemetry_head];
+    rec->id_state = (evt << 3) | (state & 0x07);
+    rec->seconds = (uint16_t)(millis() / 1000);
+    telemetry_head = (telemetry_head + 1) & TELEMETRY_MASK;
+
+    if (telemetry_count < TELEMETRY_QUEUE_SIZE) {
+        telemetry_count++;
+    } else if (telemetry_lost < 0xFF) {
+        telemetry_lost++;
+    }
+}
+
+// Fill a CMD_EVENTS reply payload; returns its length
+uint8_t telemetry_drain(uint8_t* out, uint8_t max_records) {
+    uint8_t n = telemetry_count < max_records ? telemetry_count : max_records;
+    uint8_t tail = (telemetry_head - telemetry_count) & TELEMETRY_MASK;
+    uint8_t len = 0;
+
+    out[len++] = telemetry_lost;
+    telemetry_lost = 0;
+
+    for (uint8_t i = 0; i < n; i++) {
+        const telemetry_rec_t* rec = &telemetry_queue[(tail + i) & TELEMETRY_MASK];
+        out[len++] = rec->id_state;
+        out[len++] = (uint8_t)rec->seconds;
+        out[len++] = (uint8_t)(rec->seconds >> 8);
+    }
+    telemetry_count -= n;
+    return len;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "button.h"
+#include "motion.h"
+#include "timer.h"
+
+static volatile uint32_t timer_ms = 0;
+
+void timer_init(void) {
+    TCNT0 = 0;
+    OCR0 = (uint8_t)TIMER0_TOP;
+    TCCR0 = TIMER0_CONTROL;
+    TIMSK |= (1 << OCIE0);
+
+    TCCR1A = 0;
+    TCCR1B = TIMER1_CLOCK;
+}
+
+uint32_t millis(void) {
+    uint32_t ms;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ms = timer_ms;
+    }
+    return ms;
+}
+
+uint32_t micros(void) {
+    uint32_t ms;
+    uint8_t count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ms = timer_ms;
+        count = TCNT0;
+        // Compare match happened while interrupts were off and the ISR hasn't run yet
+        if ((TIFR & (1 << OCF0)) && count < TIMER0_TOP) {
+            ms++;
+        }
+    }
+    return ms * 1000UL + (uint32_t)count * TIMER0_US_PER_COUNT;
+}
+
+// Time the tick missed while its clock was stopped in power-save
+void timer_advance(uint32_t ms) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        timer_ms += ms;
+    }
+}
+
+ISR(TIMER0_COMP_vect) {
+    timer_ms++;
+    button_tick();
+    motion_tick();
+}
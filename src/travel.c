@@ -0,0 +1,190 @@
+#include <stddef.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+#include "eeprom_layout.h"
+#include "eeprom_queue.h"
+#include "motion.h"
+#include "travel.h"
+
+#define TRAVEL_CRC_SEED 0xA7
+
+typedef struct {
+    uint16_t open_ms;
+    uint16_t close_ms;
+    uint8_t check;
+} travel_params_t;
+
+static travel_params_t travel_saved;
+static uint16_t travel_ms[2] = { GATE_OPERATION_TIME, GATE_OPERATION_TIME };
+static uint16_t travel_pos = TRAVEL_POS_CLOSED;
+static uint8_t travel_overrun = 0;        // Per direction, no endstop found since the last learned stroke
+static bool travel_unsure = false;        // The position's end came from a timeout, not an endstop
+static int16_t travel_slack = 0;          // How far the gate may be past travel_pos, + when more open
+
+static uint8_t travel_crc(const travel_params_t* p) {
+    const uint8_t* bytes = (const uint8_t*)p;
+    uint8_t crc = TRAVEL_CRC_SEED;
+    // Up to the check byte, not sizeof(): the host simulator pads the struct
+    for (uint8_t i = 0; i < offsetof(travel_params_t, check); i++) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+static bool travel_plausible(uint32_t ms) {
+    return ms >= TRAVEL_MIN_MS && ms <= GATE_OPERATION_TIME;
+}
+
+static void travel_save(void) {
+    uint16_t open_delta = travel_ms[MOTION_DIR_OPEN] > travel_saved.open_ms ?
+        travel_ms[MOTION_DIR_OPEN] - travel_saved.open_ms : travel_saved.open_ms - travel_ms[MOTION_DIR_OPEN];
+    uint16_t close_delta = travel_ms[MOTION_DIR_CLOSE] > travel_saved.close_ms ?
+        travel_ms[MOTION_DIR_CLOSE] - travel_saved.close_ms : travel_saved.close_ms - travel_ms[MOTION_DIR_CLOSE];
+    if (open_delta <= TRAVEL_SAVE_DELTA_MS && close_delta <= TRAVEL_SAVE_DELTA_MS) return;
+
+    travel_saved.open_ms = travel_ms[MOTION_DIR_OPEN];
+    travel_saved.close_ms = travel_ms[MOTION_DIR_CLOSE];
+    travel_saved.check = travel_crc(&travel_saved);
+
+    const uint8_t* bytes = (const uint8_t*)&travel_saved;
+    for (uint8_t i = 0; i < sizeof(travel_saved); i++) {
+        ee_queue_write(EE_TRAVEL_START + i, bytes[i]);
+    }
+}
+
+void travel_init(void) {
+    ee_queue_read_block(&travel_saved, EE_TRAVEL_START, sizeof(travel_saved));
+
+    if (travel_saved.check == travel_crc(&travel_saved) &&
+        travel_plausible(travel_saved.open_ms) && travel_plausible(travel_saved.close_ms)) {
+        travel_ms[MOTION_DIR_OPEN] = travel_saved.open_ms;
+        travel_ms[MOTION_DIR_CLOSE] = travel_saved.close_ms;
+    } else {
+        travel_saved.open_ms = GATE_OPERATION_TIME;
+        travel_saved.close_ms = GATE_OPERATION_TIME;
+    }
+}
+
+// Atomic for motion_position(), which the supply monitor calls from ADC_vect
+static void travel_store(uint16_t position) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        travel_pos = position;
+    }
+}
+
+void travel_set_end(uint8_t at_open) {
+    travel_store(at_open ? TRAVEL_POS_OPEN : TRAVEL_POS_CLOSED);
+    travel_slack = 0;
+    travel_unsure = false;
+}
+
+void travel_set_position(uint16_t position) {
+    travel_store(position > TRAVEL_POS_OPEN ? TRAVEL_POS_OPEN : position);
+    travel_slack = 0;
+    travel_unsure = false;
+}
+
+// The gate may be up to `slack` further open (or, negative, further closed)
+// than the estimate, e.g. from a checkpoint
+void travel_set_slack(int16_t slack) {
+    travel_slack = slack;
+}
+
+// Distance to the end of travel in `direction` by the estimate
+static uint16_t travel_remaining(uint8_t direction) {
+    return direction == MOTION_DIR_OPEN ? TRAVEL_POS_OPEN - travel_pos : travel_pos;
+}
+
+// How much further than that the end may be, when the slack points away from it
+static uint16_t travel_behind(uint8_t direction) {
+    if (direction == MOTION_DIR_OPEN) return travel_slack < 0 ? -travel_slack : 0;
+    return travel_slack > 0 ? travel_slack : 0;
+}
+
+// How much nearer the end may be, when the slack points towards it
+static uint16_t travel_ahead(uint8_t direction) {
+    return travel_behind(!direction);
+}
+
+// Furthest the end of travel in `direction` may be
+static uint16_t travel_furthest(uint8_t direction) {
+    uint16_t remaining = travel_remaining(direction) + travel_behind(direction);
+    return remaining > TRAVEL_POS_OPEN ? TRAVEL_POS_OPEN : remaining;
+}
+
+// How long to power the motor to reach the end of travel in `direction`
+uint32_t travel_run_time(uint8_t direction) {
+    // The last run this way fell short; go looking for the endstop
+    if (travel_overrun & (1 << direction)) return GATE_OPERATION_TIME;
+
+    uint32_t run_ms = (uint32_t)travel_furthest(direction) * travel_ms[direction] / TRAVEL_POS_OPEN;
+
+    run_ms += run_ms / 8 + TRAVEL_OVERRUN_MS;
+    return run_ms > GATE_OPERATION_TIME ? GATE_OPERATION_TIME : run_ms;
+}
+
+// Called by the motion state machine whenever the motor stops being powered
+void travel_moved(uint8_t direction, uint32_t run_ms, bool endstop) {
+    uint16_t start_pos = travel_pos;
+    // A run that covered the slack has reached the end, wherever it started
+    if (run_ms * TRAVEL_POS_OPEN / travel_ms[direction] >= travel_furthest(direction)) travel_slack = 0;
+    travel_store(travel_position_after(direction, run_ms));
+
+    if (!endstop) return;
+
+    bool full_stroke = !travel_unsure && direction == MOTION_DIR_OPEN ? start_pos == TRAVEL_POS_CLOSED : start_pos == TRAVEL_POS_OPEN;
+    travel_set_end(direction == MOTION_DIR_OPEN);
+
+    // The first plausible stroke is learned as it is, every later one has to
+    // end where the estimate puts the end; GATE_OPERATION_TIME itself is kept
+    // to mark a direction as unlearned
+    if (full_stroke && travel_plausible(run_ms) && run_ms < GATE_OPERATION_TIME) {
+        travel_ms[direction] = run_ms;
+        travel_overrun &= ~(1 << direction);
+        travel_save();
+    }
+}
+
+// A sensed run used up its time without finding the endstop: the gate may
+// have slowed past the margin, so it may not be at the end it is taken for
+void travel_timed_out(uint8_t direction) {
+    travel_overrun |= 1 << direction;
+    travel_unsure = true;
+}
+
+uint16_t travel_position(void) {
+    return travel_pos;
+}
+
+// Where a run of `run_ms` from the current position leaves the gate
+uint16_t travel_position_after(uint8_t direction, uint32_t run_ms) {
+    uint32_t moved = run_ms * TRAVEL_POS_OPEN / travel_ms[direction];
+
+    if (direction == MOTION_DIR_OPEN) {
+        return moved >= (uint32_t)(TRAVEL_POS_OPEN - travel_pos) ? TRAVEL_POS_OPEN : travel_pos + moved;
+    }
+    return moved >= travel_pos ? TRAVEL_POS_CLOSED : travel_pos - moved;
+}
+
+uint16_t travel_time(uint8_t direction) {
+    return travel_ms[direction];
+}
+
+bool travel_learned(uint8_t direction) {
+    return travel_ms[direction] < GATE_OPERATION_TIME;
+}
+
+// True if a run of `run_ms` from the current position ends near the end of travel
+bool travel_at_end(uint8_t direction, uint32_t run_ms) {
+    // An unlearned direction borrows the other one's time; with neither, every stop is the end
+    uint16_t stroke_ms = travel_ms[direction];
+    if (!travel_learned(direction)) {
+        if (!travel_learned(!direction)) return true;
+        stroke_ms = travel_ms[!direction];
+    }
+
+    // Slack towards the end may bring it nearer than the estimate
+    uint32_t moved = run_ms * TRAVEL_POS_OPEN / stroke_ms;
+    return moved + TRAVEL_END_WINDOW + travel_ahead(direction) >= travel_remaining(direction);
+}
@@ -0,0 +1,192 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#include "hal.h"
+#include "uart.h"
+
+static volatile char uart_tx_buf[UART_TX_BUFFER_SIZE];
+static volatile uint8_t uart_tx_head = 0;   // Written by the foreground only
+static volatile uint8_t uart_tx_tail = 0;   // Written by USART_UDRE_vect only
+static volatile bool uart_tx_started = false;
+
+#if !UART_TX_BLOCK_WHEN_FULL
+volatile uint16_t uart_tx_dropped = 0;
+
+// PROGMEM lines still to copy into the ring, foreground only
+static const char* uart_tx_lines[UART_TX_LINES];
+static uint8_t uart_tx_line_first = 0;
+static uint8_t uart_tx_parked = 0;
+#else
+#define uart_tx_parked 0
+#endif
+
+static volatile uint8_t uart_rx_buf[UART_RX_BUFFER_SIZE];
+static volatile uint8_t uart_rx_head = 0;   // Written by USART_RX_vect only
+static volatile uint8_t uart_rx_tail = 0;   // Written by the foreground only
+volatile uint8_t uart_rx_dropped = 0;
+
+void uart_init(void) {
+    UBRRH = (uint8_t)(UBRR_VALUE >> 8);
+    UBRRL = (uint8_t)(UBRR_VALUE);
+    DDRD &= ~(1 << PD0);
+    PORTD |= (1 << PD0);                        // Idle high when the RX line is unconnected
+    UCSRB = UART_CONTROL;
+    UCSRC = (1 << URSEL) | (1 << UCSZ1) | (1 << UCSZ0);
+}
+
+static void uart_tx_put(uint8_t next, char c) {
+    uart_tx_buf[uart_tx_head] = c;
+    uart_tx_head = next;
+    UCSRB |= (1 << UDRIE);
+}
+
+// Waits until the parked lines are all in the ring, so what follows keeps its place
+static void uart_tx_unpark(void) {
+    while (uart_tx_parked) {
+        uart_poll();
+        hal_spin();
+    }
+}
+
+// Only USART_UDRE_vect frees space meanwhile, so bytes that fit now fit to the end
+static bool uart_tx_fits(size_t len) {
+#if UART_TX_BLOCK_WHEN_FULL
+    (void)len;
+    return true;
+#else
+    if (len <= uart_tx_free()) return true;
+    uart_tx_dropped++;
+    return false;
+#endif
+}
+
+void uart_tx_char(char c) {
+    if (!uart_tx_fits(1)) return;
+
+    uint8_t next = (uart_tx_head + 1) & UART_TX_MASK;
+    while (next == uart_tx_tail) hal_spin();
+    uart_tx_put(next, c);
+}
+
+void uart_tx_char_wait(char c) {
+    uart_tx_unpark();
+
+    uint8_t next = (uart_tx_head + 1) & UART_TX_MASK;
+    while (next == uart_tx_tail) hal_spin();
+    uart_tx_put(next, c);
+}
+
+void uart_tx_string(const char* str) {
+    if (!uart_tx_fits(strlen(str))) return;
+    while (*str) {
+        uart_tx_char(*str++);
+    }
+}
+
+void uart_tx_string_P(const char* str) {
+#if UART_TX_BLOCK_WHEN_FULL
+    char c;
+    while ((c = pgm_read_byte(str++))) {
+        uart_tx_char(c);
+    }
+#else
+    if (uart_tx_parked == UART_TX_LINES) {
+        uart_tx_dropped++;
+        return;
+    }
+    uart_tx_lines[(uart_tx_line_first + uart_tx_parked) & UART_TX_LINES_MASK] = str;
+    uart_tx_parked++;
+    uart_poll();
+#endif
+}
+
+// Copies parked lines into the ring, oldest first, as far as it has room
+void uart_poll(void) {
+#if !UART_TX_BLOCK_WHEN_FULL
+    while (uart_tx_parked) {
+        const char** line = &uart_tx_lines[uart_tx_line_first];
+        char c;
+        while ((c = pgm_read_byte(*line))) {
+            uint8_t next = (uart_tx_head + 1) & UART_TX_MASK;
+            if (next == uart_tx_tail) return;
+            uart_tx_put(next, c);
+            (*line)++;
+        }
+        uart_tx_line_first = (uart_tx_line_first + 1) & UART_TX_LINES_MASK;
+        uart_tx_parked--;
+    }
+#endif
+}
+
+// True once every queued byte has been handed to the transmitter
+uint8_t uart_tx_idle(void) {
+    return uart_tx_parked == 0 && uart_tx_head == uart_tx_tail;
+}
+
+// True once the last byte has left the shift register too; TXC is only valid after a first byte
+bool uart_tx_done(void) {
+    return uart_tx_idle() && (!uart_tx_started || (UCSRA & (1 << TXC)));
+}
+
+// Bytes that can be queued without waiting, none while lines are parked
+uint8_t uart_tx_free(void) {
+    if (uart_tx_parked) return 0;
+    return (uart_tx_tail - uart_tx_head - 1) & UART_TX_MASK;
+}
+
+// Queued bytes with UDRIE off will never be sent; uart_tx_put() sets it after every byte
+bool uart_tx_stalled(void) {
+    return uart_tx_head != uart_tx_tail && !(UCSRB & (1 << UDRIE));
+}
+
+// Wait until the last queued byte has reached the shift register
+void uart_flush(void) {
+    uart_tx_unpark();
+    while (!uart_tx_idle()) hal_spin();
+    while (!(UCSRA & (1 << UDRE))) hal_spin();
+}
+
+uint8_t uart_rx_available(void) {
+    return uart_rx_head != uart_rx_tail;
+}
+
+// Only valid after uart_rx_available() returned true
+uint8_t uart_rx_read(void) {
+    uint8_t tail = uart_rx_tail;
+    uint8_t c = uart_rx_buf[tail];
+    uart_rx_tail = (tail + 1) & UART_RX_MASK;
+    return c;
+}
+
+ISR(USART_RX_vect) {
+    uint8_t status = UCSRA;
+    uint8_t c = UDR;
+
+    if (status & (1 << FE)) return;
+
+    uint8_t next = (uart_rx_head + 1) & UART_RX_MASK;
+    if (next == uart_rx_tail) {
+        uart_rx_dropped++;
+        return;
+    }
+
+    uart_rx_buf[uart_rx_head] = c;
+    uart_rx_head = next;
+}
+
+ISR(USART_UDRE_vect) {
+    uint8_t tail = uart_tx_tail;
+
+    if (tail == uart_tx_head) {
+        UCSRB &= ~(1 << UDRIE);
+        return;
+    }
+
+    // Writing a one clears TXC until this byte is out; UDRE must be written as zero
+    UCSRA = (UCSRA & ((1 << U2X) | (1 << MPCM))) | (1 << TXC);
+    UDR = uart_tx_buf[tail];
+    uart_tx_tail = (tail + 1) & UART_TX_MASK;
+    uart_tx_started = true;
+}